@@ -44,6 +44,10 @@
  *   tlb_read: read a TLB entry out of the TLB into ENTRYHI and ENTRYLO.
  *        INDEX specifies which one to get.
  *
+ *   tlb_setpid: load ENTRYHI into c0_entryhi without touching the TLB.
+ *        This sets the address space ID (TLBHI_PID) that the TLB
+ *        matches against. The other functions all overwrite it.
+ *
  *   tlb_probe: look for an entry matching the virtual page in ENTRYHI.
  *        Returns the index, or a negative number if no matching entry
  *        was found. ENTRYLO is not actually used, but must be set; 0
@@ -59,14 +63,15 @@ void tlb_random(uint32_t entryhi, uint32_t entrylo);
 void tlb_write(uint32_t entryhi, uint32_t entrylo, uint32_t index);
 void tlb_read(uint32_t *entryhi, uint32_t *entrylo, uint32_t index);
 int tlb_probe(uint32_t entryhi, uint32_t entrylo);
+void tlb_setpid(uint32_t entryhi);
 
 /*
  * TLB entry fields.
  *
- * Note that the MIPS has support for a 6-bit address space ID. In the
- * interests of simplicity, we don't use it. The fields related to it
- * (TLBLO_GLOBAL and TLBHI_PID) can be left always zero, as can the
- * bits that aren't assigned a meaning.
+ * Note that the MIPS has support for a 6-bit address space ID. dumbvm
+ * doesn't use it and leaves the fields related to it (TLBLO_GLOBAL and
+ * TLBHI_PID) always zero; the paged VM tags user entries with it. Bits
+ * that aren't assigned a meaning should be left zero.
  *
  * The TLBLO_DIRTY bit is actually a write privilege bit - it is not
  * ever set by the processor. If you set it, writes are permitted. If
@@ -78,7 +83,8 @@ int tlb_probe(uint32_t entryhi, uint32_t entrylo);
 
 /* Fields in the high-order word */
 #define TLBHI_VPAGE   0xfffff000
-/*      TLBHI_PID     0x00000fc0 */
+#define TLBHI_PID     0x00000fc0
+#define TLBHI_PIDSHIFT 6
 
 /* Fields in the low-order word */
 #define TLBLO_PPAGE   0xfffff000
@@ -114,6 +114,7 @@ struct tlbshootdown {
 	 */
 	struct addrspace *ts_addrspace;
 	vaddr_t ts_vaddr;
+	bool ts_last;		/* last of its batch: acknowledge it */
 };
 
 #define TLBSHOOTDOWN_MAX 16
@@ -28,6 +28,7 @@
  */
 
 #include <types.h>
+#include <kern/wait.h>
 #include <signal.h>
 #include <lib.h>
 #include <mips/specialreg.h>
@@ -39,6 +40,7 @@
 #include <vm.h>
 #include <mainbus.h>
 #include <syscall.h>
+#include "opt-vm.h"
 
 
 /* in exception.S */
@@ -108,13 +110,14 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 		break;
 	}
 
-	/*
-	 * You will probably want to change this.
-	 */
-
 	kprintf("Fatal user mode trap %u sig %d (%s, epc 0x%x, vaddr 0x%x)\n",
 		code, sig, trapcodenames[code], epc, vaddr);
+#if OPT_VM
+	/* For example, a write to a read-only page. */
+	proc_exit(_MKWAIT_SIG(sig));
+#else
 	panic("I don't know how to handle this\n");
+#endif /* OPT_VM */
 }
 
 /*
@@ -31,11 +31,13 @@
 #include <kern/errno.h>
 #include <kern/syscall.h>
 #include <lib.h>
+#include <copyinout.h>
 #include <mips/trapframe.h>
 #include <thread.h>
 #include <current.h>
 #include <syscall.h>
 #include "opt-A2.h"
+#include "opt-vm.h"
 
 /*
  * System call dispatcher.
@@ -80,6 +82,10 @@ void syscall(struct trapframe *tf)
 	int callno;
 	int32_t retval;
 	int err;
+#if OPT_VM
+	int fd;
+	off_t offset;
+#endif
 
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
@@ -130,14 +136,65 @@ void syscall(struct trapframe *tf)
 						  (pid_t *)&retval);
 		break;
 #if OPT_A2
+	case SYS_open:
+		err = sys_open((userptr_t)tf->tf_a0,
+					   (int)tf->tf_a1,
+					   (mode_t)tf->tf_a2,
+					   (int *)(&retval));
+		break;
+	case SYS_close:
+		err = sys_close((int)tf->tf_a0);
+		break;
+	case SYS_read:
+		err = sys_read((int)tf->tf_a0,
+					   (userptr_t)tf->tf_a1,
+					   (int)tf->tf_a2,
+					   (int *)(&retval));
+		break;
 	case SYS_fork:
 		err = sys_fork(tf, (pid_t *)&retval);
 		break;
+	case SYS_vfork:
+		err = sys_vfork(tf, (pid_t *)&retval);
+		break;
 	case SYS_execv:
 		err = sys_execv((char *)tf->tf_a0, (char **)tf->tf_a1);
 		break;
+	case SYS_spawn:
+		err = sys_spawn((char *)tf->tf_a0, (char **)tf->tf_a1,
+						(pid_t *)&retval);
+		break;
 #endif
 #endif // UW
+#if OPT_VM
+	case SYS_sbrk:
+		err = sys_sbrk((intptr_t)tf->tf_a0, (vaddr_t *)&retval);
+		break;
+	case SYS_mmap:
+		/* fd and the (aligned) 64-bit offset are on the stack. */
+		err = copyin((const_userptr_t)(tf->tf_sp + 16), &fd,
+			     sizeof(fd));
+		if (err == 0) {
+			err = copyin((const_userptr_t)(tf->tf_sp + 24),
+				     &offset, sizeof(offset));
+		}
+		if (err == 0) {
+			err = sys_mmap((vaddr_t)tf->tf_a0,
+				       (size_t)tf->tf_a1,
+				       (int)tf->tf_a2,
+				       (int)tf->tf_a3,
+				       fd, offset,
+				       (vaddr_t *)&retval);
+		}
+		break;
+	case SYS_munmap:
+		err = sys_munmap((vaddr_t)tf->tf_a0, (size_t)tf->tf_a1);
+		break;
+	case SYS_msync:
+		err = sys_msync((vaddr_t)tf->tf_a0, (size_t)tf->tf_a1,
+				(int)tf->tf_a2);
+		break;
+#endif
 
 		/* Add stuff here */
 
@@ -184,6 +241,10 @@ void syscall(struct trapframe *tf)
  * both it and the code that calls it.
  *
  * Thus, you can trash it and do things another way if you prefer.
+ *
+ * TF is the parent's trapframe: after fork, a copy at the top of our
+ * own stack; after vfork, the original on the parent's stack, where it
+ * stays until we give the parent its address space back.
  */
 void enter_forked_process(struct trapframe *tf)
 {
@@ -54,10 +54,15 @@
  *
  * These arrays are also used to start up new CPUs, for roughly the
  * same reasons.
+ *
+ * cpupgdirs[] holds the page directory of the address space running
+ * on each CPU, for the UTLB refill handler. It is set by the VM
+ * system; 0 sends every user TLB miss to vm_fault.
  */
 
 vaddr_t cpustacks[MAXCPUS];
 vaddr_t cputhreads[MAXCPUS];
+vaddr_t cpupgdirs[MAXCPUS];
 
 /*
  * Do machine-dependent initialization of the cpu structure or things
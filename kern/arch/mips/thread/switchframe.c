@@ -50,11 +50,15 @@ extern void mips_threadstart(/* arguments are in unusual registers */);
  * switchframe doesn't include the argument registers a0-a3. So we
  * store the arguments in the s* registers, and use a bit of asm
  * (mips_threadstart) to move them and then jump to thread_startup.
+ *
+ * The top RESERVE bytes of the stack, a multiple of 8, hold data the
+ * thread will use (see thread_fork_copy), so the switchframe goes
+ * below them.
  */
 void 
 switchframe_init(struct thread *thread,
 		 void (*entrypoint)(void *data1, unsigned long data2),
-		 void *data1, unsigned long data2)
+		 void *data1, unsigned long data2, size_t reserve)
 {
 	vaddr_t stacktop;
 	struct switchframe *sf;
@@ -64,7 +68,7 @@ switchframe_init(struct thread *thread,
          * get the other end of it. Then set up a switchframe on the
          * top of the stack.
          */
-        stacktop = ((vaddr_t)thread->t_stack) + STACK_SIZE;
+        stacktop = ((vaddr_t)thread->t_stack) + STACK_SIZE - reserve;
         sf = ((struct switchframe *) stacktop) - 1;
 
         /* Zero out the switchframe. */
@@ -0,0 +1,351 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <synch.h>
+#include <proc.h>
+#include <current.h>
+#include <mips/tlb.h>
+#include <mips/trapframe.h>
+#include <addrspace.h>
+#include <pagetable.h>
+#include <vm.h>
+#include <uw-vmstats.h>
+
+/*
+ * MIPS TLB management for the paged VM system.
+ *
+ * User translations are tagged with a 6-bit address space ID, so a
+ * context switch only has to load the new process's ASID into
+ * c0_entryhi; its old translations are still there if they have not
+ * been replaced.
+ *
+ * ASIDs are handed out per CPU, in generations. An address space
+ * remembers, for each CPU, the generation and ASID it was last given
+ * there (as_asid). When a CPU runs out of ASIDs it flushes its TLB and
+ * starts a new generation, which makes every tag from the old one
+ * stale. Zeroing an address space's tag on a CPU does the same thing
+ * for just that address space (vm_tlb_forget).
+ *
+ * Most TLB misses never get here: the UTLB handler in
+ * exception-mips1.S refills valid entries straight from the page
+ * table of the address space in cpupgdirs[]. Only faults on pages
+ * that are not valid, and protection faults, reach vm_fault.
+ */
+
+#define ASID_BITS    6
+#define ASID_FIRST   1		/* PID 0 is never given to a process */
+#define ASID_LIMIT   (1 << ASID_BITS)
+
+#define ASID_TAG(gen, pid)  (((gen) << ASID_BITS) | (pid))
+#define ASID_GEN(tag)       ((tag) >> ASID_BITS)
+#define ASID_PID(tag)       ((tag) & (ASID_LIMIT - 1))
+
+/*
+ * Shootdowns are done one batch at a time: ts_lock is held while a
+ * batch is out, and each CPU it was sent to Vs ts_done once when it
+ * has dealt with the whole batch (on its last entry, or after
+ * flushing its TLB if the batch overflowed its queue).
+ *
+ * A batch only goes to the CPUs that may have translations for one of
+ * its address spaces: those where the address space has an ASID. A
+ * CPU drops an ASID it finds is stale when asked to invalidate with
+ * it, so that it is not bothered about that address space again.
+ */
+static struct lock *ts_lock;
+static struct semaphore *ts_done;
+
+void
+vm_tlb_bootstrap(void)
+{
+	ts_lock = lock_create("tlbshootdown");
+	ts_done = sem_create("tlbshootdown", 0);
+	if (ts_lock == NULL || ts_done == NULL) {
+		panic("vm_tlb_bootstrap: out of memory\n");
+	}
+}
+
+/*
+ * Return the TLBHI PID of AS on this CPU, or -1 if it has no ASID
+ * from the current generation. Called at splhigh.
+ */
+static
+int
+vm_tlb_pid(struct addrspace *as)
+{
+	uint32_t tag;
+
+	tag = as->as_asid[curcpu->c_number];
+	if (tag == 0 || ASID_GEN(tag) != curcpu->c_asidgen) {
+		return -1;
+	}
+	return ASID_PID(tag) << TLBHI_PIDSHIFT;
+}
+
+/*
+ * Remove AS's translation for VADDR from this CPU's TLB, if it has
+ * one.
+ */
+void
+vm_tlb_invalidate(struct addrspace *as, vaddr_t vaddr)
+{
+	int i, pid, spl;
+
+	spl = splhigh();
+	pid = vm_tlb_pid(as);
+	if (pid < 0) {
+		/* Nothing of AS can be in the TLB; stop tracking it. */
+		as->as_asid[curcpu->c_number] = 0;
+	}
+	else {
+		i = tlb_probe(vaddr | pid, 0);
+		if (i >= 0) {
+			tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+		}
+		tlb_setpid(curcpu->c_tlbpid);
+	}
+	splx(spl);
+}
+
+/*
+ * Load a translation for VADDR into the TLB, replacing any existing
+ * translation for it (for example a read-only one that is now
+ * writeable). PTE is a page table entry, which is already in TLBLO
+ * format. The entry is tagged with the running process's ASID.
+ *
+ * Otherwise slots are used round-robin, per CPU. Flushing the TLB
+ * starts the hand over at slot 0, so free slots are used up before
+ * anything is replaced.
+ */
+int
+vm_tlb_load(vaddr_t vaddr, uint32_t pte)
+{
+	uint32_t ehi, elo;
+	int i, spl;
+
+	KASSERT((vaddr & PAGE_FRAME) == vaddr);
+
+	/* Disable interrupts on this CPU while frobbing the TLB. */
+	spl = splhigh();
+
+	ehi = vaddr | curcpu->c_tlbpid;
+	i = tlb_probe(ehi, 0);
+	if (i >= 0) {
+		tlb_write(ehi, pte, i);
+		splx(spl);
+		vmstats_inc(VMSTAT_TLB_FAULT_FREE);
+		return 0;
+	}
+
+	i = curcpu->c_tlbnext;
+	curcpu->c_tlbnext = (i + 1) % NUM_TLB;
+
+	tlb_read(&ehi, &elo, i);
+	tlb_write(vaddr | curcpu->c_tlbpid, pte, i);
+	splx(spl);
+
+	if (elo & TLBLO_VALID) {
+		vmstats_inc(VMSTAT_TLB_FAULT_REPLACE);
+	}
+	else {
+		vmstats_inc(VMSTAT_TLB_FAULT_FREE);
+	}
+	return 0;
+}
+
+/*
+ * Load the translation for VADDR in the page table entry *PTE, if it
+ * is valid and not in the TLB already. This is for fault-around, so
+ * the fault statistics are left alone. Returns true if an entry was
+ * loaded.
+ *
+ * The entry is read at splhigh, as the UTLB handler does, so that a
+ * shootdown cannot come in between reading it and loading it.
+ */
+bool
+vm_tlb_preload(vaddr_t vaddr, const uint32_t *pte)
+{
+	uint32_t ehi, entry;
+	int i, spl;
+
+	KASSERT((vaddr & PAGE_FRAME) == vaddr);
+
+	spl = splhigh();
+
+	entry = *pte;
+	ehi = vaddr | curcpu->c_tlbpid;
+	if ((entry & PTE_VALID) == 0 || tlb_probe(ehi, 0) >= 0) {
+		splx(spl);
+		return false;
+	}
+
+	i = curcpu->c_tlbnext;
+	curcpu->c_tlbnext = (i + 1) % NUM_TLB;
+	tlb_write(ehi, entry & ~PTE_SWBITS, i);
+
+	splx(spl);
+	return true;
+}
+
+/*
+ * Invalidate every entry in this CPU's TLB.
+ */
+void
+vm_tlb_flush(void)
+{
+	int i, spl;
+
+	spl = splhigh();
+	for (i = 0; i < NUM_TLB; i++) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+	curcpu->c_tlbnext = 0;
+	tlb_setpid(curcpu->c_tlbpid);
+	splx(spl);
+
+	vmstats_inc(VMSTAT_TLB_INVALIDATE);
+}
+
+/*
+ * Make the translations other CPUs hold for AS unusable, by dropping
+ * its ASIDs there. AS must not be running on another CPU.
+ */
+void
+vm_tlb_forget(struct addrspace *as)
+{
+	unsigned i;
+	int spl;
+
+	spl = splhigh();
+	for (i = 0; i < MAXCPUS; i++) {
+		if (i != curcpu->c_number) {
+			as->as_asid[i] = 0;
+		}
+	}
+	splx(spl);
+}
+
+void
+as_activate(void)
+{
+	struct addrspace *as;
+	struct cpu *c;
+	uint32_t tag;
+	int pid, spl;
+
+	as = curproc_getas();
+
+	spl = splhigh();
+	c = curcpu->c_self;
+
+	if (as == NULL) {
+		/* Kernel threads don't have an address spaces to activate */
+		cpupgdirs[c->c_number] = 0;
+		splx(spl);
+		return;
+	}
+
+	pid = vm_tlb_pid(as);
+	if (pid < 0) {
+		if (c->c_asidnext == ASID_LIMIT) {
+			/*
+			 * Out of ASIDs. Start a new generation; nothing
+			 * in the TLB can be trusted after that.
+			 */
+			c->c_asidgen++;
+			if (ASID_TAG(c->c_asidgen, 0) == 0) {
+				/* Wrapped; tag 0 means "none". */
+				c->c_asidgen = 1;
+			}
+			c->c_asidnext = ASID_FIRST;
+			vm_tlb_flush();
+		}
+		tag = ASID_TAG(c->c_asidgen, c->c_asidnext);
+		c->c_asidnext++;
+		as->as_asid[c->c_number] = tag;
+		pid = ASID_PID(tag) << TLBHI_PIDSHIFT;
+	}
+
+	c->c_tlbpid = pid;
+	tlb_setpid(pid);
+	cpupgdirs[c->c_number] = (vaddr_t)as->as_pt->pt_dir;
+	splx(spl);
+}
+
+void
+as_deactivate(void)
+{
+	int spl;
+
+	/* The page table may be about to go away. */
+	spl = splhigh();
+	cpupgdirs[curcpu->c_number] = 0;
+	splx(spl);
+}
+
+/*
+ * Make sure no CPU has a translation for any of the N mappings in TS,
+ * and wait until they have all dropped them. The ts_last fields are
+ * filled in here.
+ */
+void
+vm_tlb_shootdown(struct tlbshootdown *ts, unsigned n)
+{
+	uint32_t cpus;
+	unsigned i, j, count;
+	int spl;
+
+	if (n == 0) {
+		return;
+	}
+
+	cpus = 0;
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < MAXCPUS; j++) {
+			if (ts[i].ts_addrspace->as_asid[j] != 0) {
+				cpus |= (uint32_t)1 << j;
+			}
+		}
+		ts[i].ts_last = (i == n - 1);
+	}
+
+	lock_acquire(ts_lock);
+
+	/*
+	 * Stay on this CPU while invalidating here and sending the
+	 * IPIs, so that the CPU skipped by the one is the CPU done by
+	 * the other.
+	 */
+	spl = splhigh();
+	for (i = 0; i < n; i++) {
+		vm_tlb_invalidate(ts[i].ts_addrspace, ts[i].ts_vaddr);
+	}
+	count = 0;
+	if (cpus & ~((uint32_t)1 << curcpu->c_number)) {
+		count = ipi_tlbshootdown_cpus(cpus, ts, n);
+	}
+	splx(spl);
+
+	while (count > 0) {
+		P(ts_done);
+		count--;
+	}
+	lock_release(ts_lock);
+}
+
+void
+vm_tlbshootdown_all(void)
+{
+	vm_tlb_flush();
+	V(ts_done);
+}
+
+void
+vm_tlbshootdown(const struct tlbshootdown *ts)
+{
+	vm_tlb_invalidate(ts->ts_addrspace, ts->ts_vaddr);
+	if (ts->ts_last) {
+		V(ts_done);
+	}
+}
@@ -48,11 +48,16 @@
 #include <array.h>
 #include <uio.h>
 #include <synch.h>
+#include <vm.h>
 #include <lamebus/emu.h>
 #include <platform/bus.h>
 #include <vfs.h>
 #include <emufs.h>
 #include "autoconf.h"
+#include "opt-vm.h"
+#if OPT_VM
+#include <execcache.h>
+#endif
 
 /* Register offsets */
 #define REG_HANDLE    0
@@ -589,6 +594,7 @@ emufs_write(struct vnode *v, struct uio *uio)
 
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
+	result = 0;
 	while (uio->uio_resid > 0) {
 		amt = uio->uio_resid;
 		if (amt > EMU_MAXIO) {
@@ -599,7 +605,7 @@ emufs_write(struct vnode *v, struct uio *uio)
 
 		result = emu_write(ev->ev_emu, ev->ev_handle, amt, uio);
 		if (result) {
-			return result;
+			break;
 		}
 
 		if (uio->uio_resid == oldresid) {
@@ -608,7 +614,11 @@ emufs_write(struct vnode *v, struct uio *uio)
 		}
 	}
 
-	return 0;
+#if OPT_VM
+	/* Once it is written, so that no load sees the old contents. */
+	execcache_invalidate(v);
+#endif
+	return result;
 }
 
 /*
@@ -717,7 +727,13 @@ int
 emufs_truncate(struct vnode *v, off_t len)
 {
 	struct emufs_vnode *ev = v->vn_data;
-	return emu_trunc(ev->ev_emu, ev->ev_handle, len);
+	int result;
+
+	result = emu_trunc(ev->ev_emu, ev->ev_handle, len);
+#if OPT_VM
+	execcache_invalidate(v);
+#endif
+	return result;
 }
 
 /*
@@ -840,10 +856,14 @@ emufs_namefile(struct vnode *v, struct uio *uio)
  */
 static
 int
-emufs_mmap(struct vnode *v)
+emufs_mmap(struct vnode *v, off_t offset, off_t *size)
 {
-	(void)v;
-	return EUNIMP;
+	struct emufs_vnode *ev = v->vn_data;
+
+	if (offset < 0 || offset % PAGE_SIZE != 0) {
+		return EINVAL;
+	}
+	return emu_getsize(ev->ev_emu, ev->ev_handle, size);
 }
 
 //////////////////////////////
@@ -1059,6 +1079,16 @@ emufs_lookparent_notdir(struct vnode *v, char *pathname, struct vnode **result,
 }
 
 
+static
+int
+emufs_mmap_isdir(struct vnode *v, off_t offset, off_t *size)
+{
+	(void)v;
+	(void)offset;
+	(void)size;
+	return EISDIR;
+}
+
 static
 int
 emufs_truncate_isdir(struct vnode *v, off_t len)
@@ -1124,7 +1154,7 @@ static const struct vnode_ops emufs_dirops = {
 	emufs_dir_gettype,
 	emufs_dir_tryseek,
 	emufs_void_op_isdir,  /* fsync */
-	emufs_void_op_isdir,  /* mmap */
+	emufs_mmap_isdir,
 	emufs_truncate_isdir,
 	emufs_namefile,
 
@@ -41,9 +41,14 @@
 #include <bitmap.h>
 #include <uio.h>
 #include <synch.h>
+#include <vm.h>
 #include <vfs.h>
 #include <device.h>
 #include <sfs.h>
+#include "opt-vm.h"
+#if OPT_VM
+#include <execcache.h>
+#endif
 
 /* At bottom of file */
 static int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int type,
@@ -992,6 +997,10 @@ sfs_write(struct vnode *v, struct uio *uio)
 
 	vfs_biglock_acquire();
 	result = sfs_io(sv, uio);
+#if OPT_VM
+	/* Before the biglock lets anyone read the new contents. */
+	execcache_invalidate(v);
+#endif
 	vfs_biglock_release();
 
 	return result;
@@ -1110,22 +1119,32 @@ sfs_fsync(struct vnode *v)
 }
 
 /*
- * Called for mmap().
+ * Called for mmap(). The mapped pages go through sfs_read and
+ * sfs_write, so all there is to do here is check the offset.
  */
 static
 int
-sfs_mmap(struct vnode *v   /* add stuff as needed */)
+sfs_mmap(struct vnode *v, off_t offset, off_t *size)
 {
-	(void)v;
-	return EUNIMP;
+	struct sfs_vnode *sv = v->vn_data;
+
+	if (offset < 0 || offset % PAGE_SIZE != 0) {
+		return EINVAL;
+	}
+
+	vfs_biglock_acquire();
+	*size = sv->sv_i.sfi_size;
+	vfs_biglock_release();
+
+	return 0;
 }
 
 /*
- * Called for ftruncate() and from sfs_reclaim.
+ * Truncate V to LEN bytes. sfs_truncate does the rest.
  */
 static
 int
-sfs_truncate(struct vnode *v, off_t len)
+sfs_dotruncate(struct vnode *v, off_t len)
 {
 	/*
 	 * I/O buffer for handling the indirect block.
@@ -1224,6 +1243,26 @@ sfs_truncate(struct vnode *v, off_t len)
 	return 0;
 }
 
+/*
+ * Called for ftruncate() and from sfs_reclaim.
+ */
+static
+int
+sfs_truncate(struct vnode *v, off_t len)
+{
+	int result;
+
+	vfs_biglock_acquire();
+	result = sfs_dotruncate(v, len);
+#if OPT_VM
+	/* Even if it failed, some blocks may be gone. */
+	execcache_invalidate(v);
+#endif
+	vfs_biglock_release();
+
+	return result;
+}
+
 /*
  * Get the full pathname for a file. This only needs to work on directories.
  * Since we don't support subdirectories, assume it's the root directory
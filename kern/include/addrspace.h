@@ -36,8 +36,15 @@
 
 
 #include <vm.h>
+#include <spinlock.h>
+#include <platform/maxcpus.h>
+#include "opt-vm.h"
 
 struct vnode;
+#if OPT_VM
+struct array;
+struct pagetable;
+#endif
 
 
 /* 
@@ -47,6 +54,76 @@ struct vnode;
  * You write this.
  */
 
+#if OPT_VM
+
+/*
+ * The user stack starts out one page long and grows down on demand, up
+ * to VM_STACKMAXPAGES. It will not grow to within VM_STACKGUARD pages
+ * of the region below it.
+ */
+#define VM_STACKPAGES     1
+#define VM_STACKMAXPAGES  1024
+#define VM_STACKGUARD     16
+
+/*
+ * Fault-around: on a fault, up to vr_around neighbouring pages that
+ * are already resident are mapped as well. Regions start out with
+ * VM_FAULTAROUND. How many are actually looked at depends on whether
+ * the region is being scanned sequentially; see vm_fault.
+ */
+#define VM_FAULTAROUND     16
+#define VM_FAULTAROUND_MIN 2
+
+/* Region permission bits (same values as the ELF PF_ flags) */
+#define VR_EXEC   0x1
+#define VR_WRITE  0x2
+#define VR_READ   0x4
+#define VR_STACK  0x8   /* not a permission: the region grows down */
+#define VR_HEAP   0x10  /* not a permission: the region is sbrk's */
+#define VR_MMAP   0x20  /* not a permission: the region is a mapping */
+#define VR_SHARED 0x40  /* not a permission: writes go to the file */
+
+/*
+ * A region is a page-aligned range of virtual addresses with a single
+ * set of permissions. Which pages of it are resident is recorded in
+ * the address space's page table, not here.
+ *
+ * Pages are filled in on their first fault. If vr_vnode is set, the
+ * bytes from vr_filevaddr up to vr_filevaddr + vr_filesz come from
+ * that file starting at vr_fileoff (an ELF segment, or a file mapped
+ * with mmap); everything else is zero-filled. Pages of mapped files
+ * are shared through the page cache (pagecache.h).
+ */
+struct vm_region {
+  vaddr_t vr_base;     /* first virtual address of the region */
+  size_t vr_npages;    /* length in pages */
+  int vr_perm;         /* VR_READ | VR_WRITE | VR_EXEC | VR_STACK */
+  struct vnode *vr_vnode;  /* backing file, or NULL */
+  off_t vr_fileoff;        /* file offset of vr_filevaddr */
+  vaddr_t vr_filevaddr;    /* where the file data starts in memory */
+  size_t vr_filesz;        /* number of bytes that come from the file */
+  unsigned vr_around;      /* most neighbours to map on a fault */
+  unsigned vr_window;      /* how many to map next time */
+  vaddr_t vr_lastfault;    /* page of the last fault, for vr_window */
+};
+
+struct addrspace {
+  struct array *as_regions;   /* holds struct vm_region pointers */
+  struct pagetable *as_pt;    /* two-level page table */
+  uint32_t as_asid[MAXCPUS];  /* per-CPU TLB tags; see vmtlb.c */
+  struct vm_region *as_heap;  /* heap region, set by as_complete_load */
+  vaddr_t as_heapbrk;         /* current break (end of the heap) */
+
+  /* Working-set statistics, for as_getstats */
+  struct spinlock as_statlock;
+  unsigned as_rss;            /* resident pages */
+  unsigned as_faults;         /* faults handled by vm_fault */
+  unsigned as_lastfaults;     /* as_faults at the last report */
+  time_t as_lastsec;          /* time of the last report */
+  uint32_t as_lastnsec;
+};
+
+#else
 struct addrspace {
   vaddr_t as_vbase1;
   paddr_t as_pbase1;
@@ -56,6 +133,7 @@ struct addrspace {
   size_t as_npages2;
   paddr_t as_stackpbase;
 };
+#endif /* OPT_VM */
 
 /*
  * Functions in addrspace.c:
@@ -108,6 +186,75 @@ int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
 
+#if OPT_VM
+/*
+ *    as_find_region - return the region containing VADDR, or NULL if
+ *                the address is not part of the address space.
+ */
+struct vm_region *as_find_region(struct addrspace *as, vaddr_t vaddr);
+
+/*
+ *    as_grow_stack - if VADDR is below the stack, but within its limit
+ *                and clear of the guard gap, grow the stack down to
+ *                cover it and return the stack region. Otherwise
+ *                return NULL.
+ */
+struct vm_region *as_grow_stack(struct addrspace *as, vaddr_t vaddr);
+
+/*
+ *    as_sbrk   - move the end of the heap by AMOUNT bytes, returning
+ *                the old end in *OLDBRK. Pages are added without
+ *                backing (they are zero-filled on demand) and removed
+ *                pages are freed.
+ */
+int as_sbrk(struct addrspace *as, intptr_t amount, vaddr_t *oldbrk);
+
+/*
+ *    as_mmap   - add a mapping of NPAGES pages with permissions PERM,
+ *                somewhere between the heap and the lowest the stack
+ *                can grow to. It goes at ADDR if that is free, and
+ *                as high as there is room otherwise; if FIXED is set
+ *                it goes at ADDR or not at all. Pages are zero-filled
+ *                on demand.
+ *
+ *    as_munmap - remove the pages of mappings in LEN bytes from ADDR,
+ *                freeing them. Fails if the range includes something
+ *                that is not a mapping.
+ */
+int as_mmap(struct addrspace *as, vaddr_t addr, size_t npages, int perm,
+	    bool fixed, struct vm_region **ret);
+int as_munmap(struct addrspace *as, vaddr_t addr, size_t len);
+
+/*
+ *    as_msync  - write back the dirty pages of shared file mappings in
+ *                LEN bytes from ADDR. Fails with ENOMEM if the range
+ *                includes something that is not a mapping.
+ */
+int as_msync(struct addrspace *as, vaddr_t addr, size_t len);
+
+/*
+ *    as_addrss - add DELTA to the count of resident pages.
+ *
+ *    as_addfault - count a fault.
+ *
+ *    as_getstats - return the number of resident pages, the number of
+ *                faults, and the faults per second since the last call
+ *                (or since the address space was created).
+ */
+void as_addrss(struct addrspace *as, int delta);
+void as_addfault(struct addrspace *as);
+void as_getstats(struct addrspace *as, unsigned *rss, unsigned *faults,
+		 unsigned *rate);
+
+/*
+ *    as_define_filedata - record that FILESIZE bytes at VADDR (inside a
+ *                region already set up by as_define_region) are to be
+ *                read from V at OFFSET when first touched.
+ */
+int as_define_filedata(struct addrspace *as, struct vnode *v, off_t offset,
+                       vaddr_t vaddr, size_t filesize);
+#endif
+
 
 /*
  * Functions in loadelf.c
@@ -0,0 +1,124 @@
+#ifndef _COREMAP_H_
+#define _COREMAP_H_
+
+/*
+ * Physical frame allocator.
+ *
+ * The coremap has one entry for every page frame handed to the VM
+ * system by ram_getsize(). Free frames are kept on a doubly-linked
+ * list so that single-page allocation and freeing are O(1); kernel
+ * allocations of more than one page search for a contiguous run.
+ * Idle CPUs zero a few free frames in advance and keep them on a
+ * second list, so that zero-fill faults need not wait for it.
+ *
+ * Every allocated frame has a reference count. A frame is returned to
+ * the free list when its count drops to zero.
+ *
+ * User frames can also be paged out (see swap.h). A user frame is a
+ * candidate for eviction once it has been claimed by the single page
+ * table entry that maps it. While the VM system is working on a frame
+ * it keeps the frame pinned, which holds off eviction and anyone else
+ * who wants to pin it. Frames are pinned when allocated, and freeing a
+ * frame unpins it.
+ */
+
+#include <vm.h>
+
+struct addrspace;
+
+/* A frame chosen for eviction, and the page it backs */
+struct cm_victim {
+	paddr_t cv_paddr;
+	struct addrspace *cv_as;
+	vaddr_t cv_vaddr;
+	unsigned cv_swapslot;		/* clean copy in swap, or SWAP_NOSLOT */
+	bool cv_text;			/* shared text page; see textcache.h */
+	bool cv_file;			/* mapped file page; see pagecache.h */
+};
+
+/* Set up the coremap. Called once from vm_bootstrap. */
+void coremap_bootstrap(void);
+
+/*
+ * Allocate NPAGES physically contiguous frames with a reference count
+ * of one. KERNEL marks the frames as kernel memory (kmalloc and
+ * friends); otherwise NPAGES must be 1. Returns 0 if out of memory.
+ */
+paddr_t coremap_alloc(unsigned npages, bool kernel);
+
+/*
+ * Allocate a user frame that is already zero-filled, as coremap_alloc
+ * would. Returns 0 if there are none ready.
+ */
+paddr_t coremap_alloc_zeroed(void);
+
+/*
+ * Zero one free frame for coremap_alloc_zeroed, if the pool of them is
+ * not full. Returns false if there was nothing to do. Called from the
+ * idle loop; does not sleep.
+ */
+bool coremap_zero_one(void);
+
+/*
+ * Drop one reference to the allocation starting at PADDR, freeing it
+ * when the last reference goes away.
+ */
+void coremap_free(paddr_t paddr);
+
+/* Add a reference to the frame at PADDR. */
+void coremap_incref(paddr_t paddr);
+
+/* Return the number of references to the frame at PADDR. */
+unsigned coremap_refcount(paddr_t paddr);
+
+/* Return true if PADDR is managed by the coremap. */
+bool coremap_owns(paddr_t paddr);
+
+/*
+ * Pin the user frame at PADDR. If it is already pinned, wait for it
+ * to be unpinned and return false without pinning it; also return
+ * false if it is no longer a user frame. Either way the caller should
+ * look at its page table entry again.
+ */
+bool coremap_pin(paddr_t paddr);
+
+/* Unpin the frame at PADDR. */
+void coremap_unpin(paddr_t paddr);
+
+/*
+ * Record that the pinned frame at PADDR backs VADDR in AS, which makes
+ * it evictable, provided nobody else shares it.
+ */
+void coremap_claim(paddr_t paddr, struct addrspace *as, vaddr_t vaddr);
+
+/* Note that the pinned frame at PADDR is a clean copy of swap SLOT. */
+void coremap_setslot(paddr_t paddr, unsigned slot);
+
+/* Note that the pinned frame at PADDR is in the text cache. */
+void coremap_settext(paddr_t paddr);
+
+/* Note that the pinned frame at PADDR is in the mapped file cache. */
+void coremap_setfile(paddr_t paddr);
+
+/* The pinned frame at PADDR is being written; drop its swap copy. */
+void coremap_dirty(paddr_t paddr);
+
+/*
+ * Choose up to MAX evictable frames, pin them, and fill in VICTIMS.
+ * Returns how many were chosen. Up to MAXREFS recently used pages are
+ * passed over instead and marked unreferenced; they are listed in
+ * REFS, their frames in REFFRAMES, and their number returned in
+ * *NREFS. Those frames are pinned as well: the caller must shoot down
+ * their translations and then unpin them.
+ */
+unsigned coremap_pick_victims(struct cm_victim *victims, unsigned max,
+			      struct tlbshootdown *refs, paddr_t *refframes,
+			      unsigned maxrefs, unsigned *nrefs);
+
+/* Free a victim frame whose page has been written out. */
+void coremap_evicted(paddr_t paddr);
+
+/* Print frame usage. */
+void coremap_printstats(void);
+
+#endif /* _COREMAP_H_ */
@@ -34,6 +34,7 @@
 #include <spinlock.h>
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
+#include "opt-vm.h"
 
 
 /*
@@ -60,6 +61,12 @@ struct cpu {
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+#if OPT_VM
+	unsigned c_tlbnext;		/* Next TLB slot to (re)load */
+	uint32_t c_asidgen;		/* Current ASID generation */
+	uint32_t c_asidnext;		/* Next ASID to hand out */
+	uint32_t c_tlbpid;		/* TLBHI PID of the running process */
+#endif
 
 	/*
 	 * Accessed by other cpus.
@@ -152,6 +159,9 @@ void cpu_halt(void);
  * ipi_send sends an IPI to one CPU.
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
+ * ipi_tlbshootdown_cpus sends several mappings at once, with one IPI
+ * each, to the CPUs in a mask of CPU numbers other than the current
+ * one, and returns how many CPUs that was.
  *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
@@ -166,6 +176,11 @@ void cpu_halt(void);
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
 void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+#if OPT_VM
+unsigned ipi_tlbshootdown_cpus(uint32_t cpumask,
+			       const struct tlbshootdown *mappings,
+			       unsigned n);
+#endif
 
 void interprocessor_interrupt(void);
 
@@ -0,0 +1,80 @@
+#ifndef _EXECCACHE_H_
+#define _EXECCACHE_H_
+
+/*
+ * Cache of executable images.
+ *
+ * load_elf records what it learns from an executable's headers, the
+ * entry point and the loadable segments, keyed by vnode, so that
+ * running the program again reads nothing before it starts. The cache
+ * also holds on to the text cache frames (see textcache.h) of the
+ * program's read-only segments when the processes that mapped them go
+ * away, so that the next run finds them resident. These are the only
+ * references it holds on frames; they are given back when memory is
+ * short (execcache_shrink).
+ *
+ * Writing or truncating a file drops everything cached about it,
+ * including its text cache pages (execcache_invalidate). Headers read
+ * before such a change are not entered after it; as with text pages,
+ * that is told by the text cache's generation (textcache_gen).
+ */
+
+#include <vm.h>
+
+struct vnode;
+
+/* Most executables cached at once */
+#define EXECCACHE_NENTRIES 8
+
+/* Most loadable segments in an executable we cache */
+#define EXECCACHE_MAXSEGS  8
+
+/* A loadable segment, from its program header */
+struct execcache_seg {
+	off_t es_offset;	/* where its data is in the file */
+	vaddr_t es_vaddr;
+	size_t es_memsz;
+	size_t es_filesz;	/* no more than es_memsz */
+	uint32_t es_flags;	/* PF_R, PF_W, PF_X */
+};
+
+/* What load_elf needs to know about an executable */
+struct execcache_image {
+	vaddr_t ei_entry;
+	unsigned ei_nsegs;
+	struct execcache_seg ei_segs[EXECCACHE_MAXSEGS];
+};
+
+/*
+ * Look up executable V. Returns false if it is not cached; otherwise
+ * fills in *IMAGE.
+ */
+bool execcache_lookup(struct vnode *v, struct execcache_image *image);
+
+/* Remember IMAGE, read from the headers of V at generation GEN. */
+void execcache_enter(struct vnode *v, const struct execcache_image *image,
+		     unsigned gen);
+
+/*
+ * The pinned text cache frame PADDR, which backs page VADDR of V, is
+ * being unmapped. If V is cached and does not have that page yet,
+ * take a reference to it.
+ */
+void execcache_keep(struct vnode *v, vaddr_t vaddr, paddr_t paddr);
+
+/*
+ * Release the frames held for the least recently run executable that
+ * has any. Returns false if there were none.
+ */
+bool execcache_shrink(void);
+
+/*
+ * V has been written or truncated; forget it. Call before anyone can
+ * read the new contents.
+ */
+void execcache_invalidate(struct vnode *v);
+
+/* Forget everything, so that file systems can be unmounted. */
+void execcache_purge(void);
+
+#endif /* _EXECCACHE_H_ */
@@ -0,0 +1,39 @@
+#ifndef _FILE_H_
+#define _FILE_H_
+
+/*
+ * Open files.
+ *
+ * Descriptors 0-2 are still the console (see proc.h). Descriptors from
+ * FILE_FIRSTFD up index the process's p_files table. Each entry is an
+ * open file that fork shares between parent and child, along with its
+ * offset.
+ */
+
+#include <limits.h>
+
+struct proc;
+struct vnode;
+struct lock;
+
+/* First descriptor that is not the console's */
+#define FILE_FIRSTFD 3
+
+struct openfile {
+	struct vnode *of_vnode;
+	int of_flags;			/* O_ flags it was opened with */
+	struct lock *of_lock;		/* for of_offset and of_refcount */
+	off_t of_offset;
+	unsigned of_refcount;		/* descriptors that refer to it */
+};
+
+/* Find descriptor FD of the current process. EBADF if it isn't open. */
+int file_get(int fd, struct openfile **ret);
+
+/* Give CHILD, which has no open files, those of the current process. */
+void file_inherit(struct proc *child);
+
+/* Close every open file of P. */
+void file_closeall(struct proc *p);
+
+#endif /* _FILE_H_ */
@@ -0,0 +1,29 @@
+#ifndef _KERN_MMAN_H_
+#define _KERN_MMAN_H_
+
+/*
+ * Definitions for mmap() and munmap().
+ */
+
+/* Protections for the prot argument */
+#define PROT_NONE     0x0      /* Page can't be accessed */
+#define PROT_READ     0x1      /* Page can be read */
+#define PROT_WRITE    0x2      /* Page can be written */
+#define PROT_EXEC     0x4      /* Page can be executed */
+
+/* Flags for the flags argument */
+#define MAP_SHARED    0x0001   /* Changes are shared */
+#define MAP_PRIVATE   0x0002   /* Changes are private */
+#define MAP_FIXED     0x0010   /* Map exactly at the address given */
+#define MAP_ANON      0x1000   /* Not backed by a file; zero-filled */
+
+/* Flags for msync */
+#define MS_ASYNC      0x1      /* Write back in the background */
+#define MS_SYNC       0x2      /* Write back before returning */
+#define MS_INVALIDATE 0x4      /* Drop other cached copies */
+
+/* Returned by mmap on error */
+#define MAP_FAILED    ((void *)-1)
+
+
+#endif /* _KERN_MMAN_H_ */
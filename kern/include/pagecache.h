@@ -0,0 +1,68 @@
+#ifndef _PAGECACHE_H_
+#define _PAGECACHE_H_
+
+/*
+ * Cache of file pages mapped with mmap.
+ *
+ * Every process that maps a given page of a file gets the same frame,
+ * found by (vnode, file offset). As with the text cache, the cache
+ * holds no references of its own: a frame stays in it for as long as
+ * some page table maps it. Pages written through a shared mapping are
+ * marked dirty, and written back to the file when the last mapping
+ * goes away, when the frame is evicted, and on msync.
+ *
+ * Only the LEN bytes of a page that lie within the file when it is
+ * read in are ever written back; the rest is zeroes.
+ *
+ * The cache is not coherent with read and write. They go straight to
+ * the file, so a write is not seen through a mapping that already has
+ * the page, and a page written through a shared mapping is not seen
+ * by read until it is written back (by msync, eviction, or the last
+ * unmap). The cache never drops a page that is still mapped, so it
+ * cannot simply be invalidated when the file is written.
+ */
+
+#include <vm.h>
+
+struct vnode;
+
+/*
+ * Look up the page at OFFSET in V. Returns its frame with a new
+ * reference, or 0 if it is not cached.
+ */
+paddr_t pagecache_get(struct vnode *v, off_t offset);
+
+/*
+ * Enter the freshly read, pinned frame PADDR as the page at OFFSET in
+ * V, LEN bytes of which come from the file. If someone else got there
+ * first, their frame is returned, with a new reference, and the caller
+ * should free its own; otherwise PADDR is returned.
+ */
+paddr_t pagecache_add(struct vnode *v, off_t offset, size_t len,
+		      paddr_t paddr);
+
+/* Note that the page at OFFSET in V is being written. */
+void pagecache_dirty(struct vnode *v, off_t offset);
+
+/*
+ * If the page at OFFSET in V, whose frame PADDR the caller has pinned,
+ * is dirty, write it to the file. It stays dirty, as other mappings
+ * may still be writing it.
+ */
+int pagecache_sync(struct vnode *v, off_t offset, paddr_t paddr);
+
+/*
+ * Drop a reference to the pinned frame PADDR, which holds the page at
+ * OFFSET in V. With the last reference, a dirty page is written back
+ * and taken out of the cache.
+ */
+void pagecache_release(struct vnode *v, off_t offset, paddr_t paddr);
+
+/*
+ * Take the pinned, unmapped frame PADDR out of the cache so that it
+ * can be evicted, writing it back first if it is dirty. Returns false,
+ * and leaves it alone, if it is shared or cannot be written.
+ */
+bool pagecache_evict(paddr_t paddr);
+
+#endif /* _PAGECACHE_H_ */
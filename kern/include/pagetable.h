@@ -0,0 +1,77 @@
+#ifndef _PAGETABLE_H_
+#define _PAGETABLE_H_
+
+/*
+ * Two-level page table for user address spaces.
+ *
+ * A virtual address is split into a 10-bit directory index, a 10-bit
+ * table index and a 12-bit page offset. Only the part of the
+ * directory that covers kuseg is kept, and second-level tables are
+ * allocated the first time a page in their 4MB range is mapped, so a
+ * typical process needs only a handful of tables.
+ *
+ * Page table entries are kept in the same format as TLBLO, so that a
+ * resident page can be loaded into the TLB without translation. The
+ * low byte of TLBLO is ignored by the hardware; the VM system keeps
+ * its own bits there, and masks them off before loading the TLB.
+ *
+ * An entry is in one of four states:
+ *    0                          never touched
+ *    frame | PTE_PRESENT | ...  resident in the frame PTE_FRAME
+ *    PTE_MKSWAP(slot)           paged out to swap slot PTE_SWAPSLOT, with
+ *                               PTE_ZCMISS if the zcache turned it away
+ *    PTE_MKZC(index)            paged out to zcache entry PTE_ZCINDEX
+ *
+ * The MIPS has no reference bits, so PTE_VALID stands in for one. The
+ * page replacement clock clears it on resident pages it passes; the
+ * next access then faults, and vm_fault sets it again.
+ */
+
+#include <vm.h>
+#include <machine/tlb.h>
+
+typedef uint32_t pte_t;
+
+/* Fields of a page table entry */
+#define PTE_FRAME   TLBLO_PPAGE   /* physical page number */
+#define PTE_WRITE   TLBLO_DIRTY   /* page may be written */
+#define PTE_VALID   TLBLO_VALID   /* translation may be loaded */
+#define PTE_PRESENT 0x00000001    /* page is resident (software) */
+#define PTE_SWAPPED 0x00000002    /* page is in swap (software) */
+#define PTE_TEXT    0x00000004    /* frame is in the text cache (software) */
+#define PTE_ZCACHED 0x00000008    /* page is in the zcache (software) */
+#define PTE_FILE    0x00000010    /* frame is in the page cache (software) */
+#define PTE_ZCMISS  0x00000020    /* swapped after the zcache refused it (software) */
+#define PTE_SWBITS  0x000000ff    /* all software bits */
+
+#define PTE_SWAPSLOT(pte)  ((pte) >> 12)
+#define PTE_MKSWAP(slot)   (((pte_t)(slot) << 12) | PTE_SWAPPED)
+#define PTE_ZCINDEX(pte)   ((pte) >> 12)
+#define PTE_MKZC(index)    (((pte_t)(index) << 12) | PTE_ZCACHED)
+
+#define PT_L1_SHIFT   22
+#define PT_L2_SHIFT   12
+#define PT_L1_SIZE    (USERSPACETOP >> PT_L1_SHIFT)
+#define PT_L2_SIZE    1024
+
+#define PT_L1_INDEX(va)  ((va) >> PT_L1_SHIFT)
+#define PT_L2_INDEX(va)  (((va) >> PT_L2_SHIFT) & (PT_L2_SIZE - 1))
+
+struct pagetable {
+	pte_t *pt_dir[PT_L1_SIZE];	/* second-level tables, or NULL */
+};
+
+/* Create an empty page table. Returns NULL if out of memory. */
+struct pagetable *pt_create(void);
+
+/* Free the page table itself. Frames it points to are not freed. */
+void pt_destroy(struct pagetable *pt);
+
+/*
+ * Return a pointer to the entry for VADDR. If the second-level table
+ * for VADDR does not exist yet it is allocated when CREATE is true;
+ * otherwise (or if that allocation fails) NULL is returned.
+ */
+pte_t *pt_lookup(struct pagetable *pt, vaddr_t vaddr, bool create);
+
+#endif /* _PAGETABLE_H_ */
@@ -39,23 +39,19 @@
 #include <spinlock.h>
 #include <synch.h>
 #include <thread.h> /* required for struct threadarray */
+#include <limits.h>
 #include "opt-A2.h"
+#include "opt-vm.h"
 
 struct addrspace;
 struct vnode;
+struct openfile;
 #ifdef UW
 struct semaphore;
 #endif // UW
 
-// important info about process (addr of proc and error code if it exits)
-#if OPT_A2
-struct proc_info
-{
-	struct proc *proc_addr;
-	pid_t pid;
-	int exit_code;
-};
-#endif
+/* Longest process name kept, counting the NUL; longer ones are cut short */
+#define PROC_NAMELEN 32
 
 /*
  * Process structure.
@@ -64,13 +60,22 @@ struct proc
 {
 #if OPT_A2
 	pid_t pid;
-	struct array *children_info; // holds addresses to proc_info structs
-	struct cv *is_dying;
-	struct lock *child_lock; // many children could be modifying children_info array
-	struct proc *parent;
-	struct trapframe *tf;
+	/* The fields from here to exit_status are protected by proc_family_lock. */
+	struct proc *parent;		 // NULL if none, or it has exited
+	struct proc *children;		 // first child, running or exited
+	struct proc *sibling_next;	 // next child of our parent
+	struct proc *sibling_prev;
+	struct proc *zombies;		 // exited children not waited for, oldest first
+	struct proc *zombies_tail;
+	struct proc *zombie_next;	 // next on our parent's zombies
+	struct proc *zombie_prev;
+	struct cv *child_exited;	 // signalled when a child exits
+	bool exited;
+	int exit_status;			 // wait status, once exited
+	struct semaphore *vfork_sem; // parent waiting for us to exec or exit, if vforked
+	struct openfile *p_files[OPEN_MAX]; // open files, from FILE_FIRSTFD; see file.h
 #endif
-	char *p_name;				  /* Name of this process */
+	char p_name[PROC_NAMELEN];	  /* Name of this process */
 	struct spinlock p_lock;		  /* Lock for this structure */
 	struct threadarray p_threads; /* Threads in this process */
 
@@ -92,6 +97,11 @@ struct proc
 	/* add more material here as needed */
 };
 
+#if OPT_A2
+/* Most user processes at once, counting exited ones not waited for */
+#define PROC_TABLESIZE 256
+#endif
+
 /* This is the process structure for the kernel and for kernel-only threads. */
 extern struct proc *kproc;
 
@@ -100,12 +110,36 @@ extern struct proc *kproc;
 extern struct semaphore *no_proc_sem;
 #endif // UW
 
+#if OPT_A2
+/* Lock for every process's parent, children and zombies */
+extern struct lock *proc_family_lock;
+#endif
+
 /* Call once during system startup to allocate data structures. */
 void proc_bootstrap(void);
 
 /* Create a fresh process for use by runprogram(). */
 struct proc *proc_create_runprogram(const char *name);
 
+#if OPT_A2
+/*
+ * Create a child for the current process, with its name, console and
+ * current directory but no address space, for fork and the like.
+ * Returns ENPROC if the process table is full.
+ */
+int proc_create_child(struct proc **ret);
+#endif
+
+#if OPT_A2
+/*
+ * Find the child of PARENT whose PID is PID. Returns ESRCH if there is
+ * no such process and ECHILD if it is not PARENT's. Call with
+ * proc_family_lock held, which keeps the child from being destroyed
+ * until it is released.
+ */
+int proc_findchild(struct proc *parent, pid_t pid, struct proc **ret);
+#endif
+
 /* Destroy a process. */
 void proc_destroy(struct proc *proc);
 
@@ -124,4 +158,9 @@ struct addrspace *curproc_setas(struct addrspace *);
 /* Set the address space of proc, return old one */
 struct addrspace *proc_setas(struct addrspace *newas, struct proc *proc);
 
+#if OPT_VM
+/* Print each user process's resident set size and fault rate. */
+void proc_printvmstats(void);
+#endif
+
 #endif /* _PROC_H_ */
@@ -0,0 +1,46 @@
+#ifndef _SWAP_H_
+#define _SWAP_H_
+
+/*
+ * Swap space.
+ *
+ * Pages are paged out to a raw disk device, opened through the VFS
+ * layer, in page-sized slots tracked by a bitmap. If the device
+ * cannot be opened, only pages the compressed cache will take and
+ * text pages can be evicted.
+ */
+
+#include <vm.h>
+
+/* Device used for swap. */
+#define SWAP_DEVICE  "lhd1raw:"
+
+/* "No slot" value */
+#define SWAP_NOSLOT  0xffffffff
+
+/* Most pages written to swap in one I/O. */
+#define SWAP_CLUSTER 8
+
+/*
+ * Most referenced pages the replacement clock passes over per round;
+ * with SWAP_CLUSTER this fits in one shootdown batch.
+ */
+#define SWAP_CLOCKREFS (TLBSHOOTDOWN_MAX - SWAP_CLUSTER)
+
+/* Open the swap device. Called once from vm_bootstrap. */
+void swap_bootstrap(void);
+
+/* Read swap slot SLOT into the frame at PADDR. */
+int swap_in(unsigned slot, paddr_t paddr);
+
+/* Release swap slot SLOT. */
+void swap_free(unsigned slot);
+
+/*
+ * Page out some user pages to free up memory, into the compressed
+ * cache if they compress and to swap otherwise. Returns 0 if at least
+ * one frame was freed, and ENOMEM if nothing could be evicted.
+ */
+int swap_evict(void);
+
+#endif /* _SWAP_H_ */
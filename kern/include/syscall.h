@@ -30,6 +30,8 @@
 #ifndef _SYSCALL_H_
 #define _SYSCALL_H_
 
+#include "opt-vm.h"
+
 struct trapframe; /* from <machine/trapframe.h> */
 
 /*
@@ -58,12 +60,31 @@ int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
 
 #ifdef UW
 int sys_write(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval);
+int sys_read(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval);
+int sys_open(userptr_t path, int flags, mode_t mode, int *retval);
+int sys_close(int fd);
 void sys__exit(int exitcode);
 int sys_getpid(pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
 int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
 int sys_execv(const char *program_name, char **args);
+int sys_spawn(const char *program_name, char **args, pid_t *retval);
+
+/*
+ * Exit the current process with wait status STATUS, made with
+ * _MKWAIT_EXIT or _MKWAIT_SIG. Does not return.
+ */
+void proc_exit(int status);
 
 #endif // UW
 
+#if OPT_VM
+int sys_sbrk(intptr_t amount, vaddr_t *retval);
+int sys_mmap(vaddr_t addr, size_t len, int prot, int flags, int fd,
+             off_t offset, vaddr_t *retval);
+int sys_munmap(vaddr_t addr, size_t len);
+int sys_msync(vaddr_t addr, size_t len, int flags);
+#endif
+
 #endif /* _SYSCALL_H_ */
@@ -79,6 +79,7 @@ int printfile(int, char **);
 int malloctest(int, char **);
 int mallocstress(int, char **);
 int nettest(int, char **);
+int coremaptest(int, char **);
 
 /* Routine for running a user-level program. */
 #if OPT_A2
@@ -0,0 +1,65 @@
+#ifndef _TEXTCACHE_H_
+#define _TEXTCACHE_H_
+
+/*
+ * Cache of shared read-only program pages.
+ *
+ * Pages of read-only segments (text, rodata) are the same in every
+ * process running a given executable, so they are loaded once and
+ * shared. The cache maps (vnode, virtual address) to the frame holding
+ * that page. It does not hold references of its own: a frame stays in
+ * the cache for as long as some page table maps it, or the exec image
+ * cache (execcache.h) keeps it.
+ *
+ * When an executable has been written, its pages are marked stale.
+ * Lookups no longer find them, so the next process to run it reads the
+ * new contents, but they stay in the cache until the processes already
+ * using them let go. A page read before the write but entered after it
+ * is entered stale too: loaders sample the file's generation, which
+ * every invalidation advances, before they read.
+ */
+
+#include <vm.h>
+
+struct vnode;
+
+/*
+ * Look up page VADDR of executable V. Returns its frame with a new
+ * reference, or 0 if it is not cached.
+ */
+paddr_t textcache_get(struct vnode *v, vaddr_t vaddr);
+
+/* Return V's generation; sample it before reading from V. */
+unsigned textcache_gen(struct vnode *v);
+
+/*
+ * Enter the freshly loaded, pinned frame PADDR as page VADDR of V,
+ * read at generation GEN. If someone else got there first, their
+ * frame is returned, with a new reference, and the caller should free
+ * its own; otherwise PADDR is returned.
+ */
+paddr_t textcache_add(struct vnode *v, vaddr_t vaddr, paddr_t paddr,
+		      unsigned gen);
+
+/*
+ * Drop a reference to the pinned frame PADDR, which backs page VADDR
+ * of V, taking it out of the cache with the last reference.
+ */
+void textcache_release(struct vnode *v, vaddr_t vaddr, paddr_t paddr);
+
+/*
+ * Take the pinned frame PADDR out of the cache so that it can be
+ * evicted. Returns false, and leaves it alone, if it is shared.
+ */
+bool textcache_evict(paddr_t paddr);
+
+/*
+ * Return true if PADDR is the frame lookups find for page VADDR of V,
+ * that is, if it has not been marked stale.
+ */
+bool textcache_current(struct vnode *v, vaddr_t vaddr, paddr_t paddr);
+
+/* V has been changed; mark all its pages stale. */
+void textcache_invalidate(struct vnode *v);
+
+#endif /* _TEXTCACHE_H_ */
@@ -55,6 +55,9 @@ struct cpu;
 /* Macro to test if two addresses are on the same kernel stack */
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
+/* Longest thread name kept, counting the NUL; longer ones are cut short */
+#define THREAD_NAMELEN 32
+
 
 /* States a thread can be in. */
 typedef enum {
@@ -70,7 +73,7 @@ struct thread {
 	 * These go up front so they're easy to get to even if the
 	 * debugger is messed up.
 	 */
-	char *t_name;			/* Name of this thread */
+	char t_name[THREAD_NAMELEN];	/* Name of this thread */
 	const char *t_wchan_name;	/* Name of wait channel, if sleeping */
 	threadstate_t t_state;		/* State this thread is in */
 
@@ -144,6 +147,15 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Like thread_fork, but "func" gets a pointer to a copy of the "len"
+ * bytes at "data1", which lives on the new thread's stack for as long
+ * as it runs.
+ */
+int thread_fork_copy(const char *name, struct proc *proc,
+                     void (*func)(void *, unsigned long),
+                     const void *data1, size_t len, unsigned long data2);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
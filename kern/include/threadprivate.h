@@ -69,10 +69,10 @@ void thread_machdep_cleanup(struct thread_machdep *tm);
 /* Assembler-level context switch. */
 void switchframe_switch(struct switchframe **prev, struct switchframe **next);
 
-/* Thread initialization */
+/* Thread initialization; the top RESERVE bytes of the stack are left alone */
 void switchframe_init(struct thread *,
 		      void (*entrypoint)(void *data1, unsigned long data2),
-		      void *data1, unsigned long data2);
+		      void *data1, unsigned long data2, size_t reserve);
 
 
 #endif /* _THREADPRIVATE_H_ */
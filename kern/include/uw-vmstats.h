@@ -36,7 +36,17 @@
 #define VMSTAT_ELF_FILE_READ          (7)
 #define VMSTAT_SWAP_FILE_READ         (8)
 #define VMSTAT_SWAP_FILE_WRITE        (9)
-#define VMSTAT_COUNT                 (10)
+#define VMSTAT_ZERO_POOL_HIT         (10)
+#define VMSTAT_ZERO_POOL_MISS        (11)
+#define VMSTAT_TLB_FAULTAROUND       (12)
+#define VMSTAT_ZCACHE_HIT            (13)
+#define VMSTAT_ZCACHE_MISS           (14)
+#define VMSTAT_ZCACHE_STORE          (15)
+#define VMSTAT_ZCACHE_BYTES          (16)
+#define VMSTAT_TEXT_HIT              (17)
+#define VMSTAT_PAGECACHE_HIT         (18)
+#define VMSTAT_FILE_READ             (19)
+#define VMSTAT_COUNT                 (20)
 
 /* ----------------------------------------------------------------------- */
 
@@ -52,6 +62,10 @@ void _vmstats_init(void);                    /* atomicity must be ensured elsewh
 void vmstats_inc(unsigned int index);    /* uses locking */
 void _vmstats_inc(unsigned int index);   /* atomicity must be ensured elsewhere */
 
+/* Add N to the specified count */
+void vmstats_add(unsigned int index, unsigned int n);    /* uses locking */
+void _vmstats_add(unsigned int index, unsigned int n);   /* atomicity must be ensured elsewhere */
+
 /* Print the statistics: assumes that at least vmstats_init has been called */
 void vmstats_print(void);                    /* Does NOT use locking */
 
@@ -59,5 +59,54 @@ void free_kpages(vaddr_t addr);
 void vm_tlbshootdown_all(void);
 void vm_tlbshootdown(const struct tlbshootdown *);
 
+/*
+ * Paged VM (options vm)
+ */
+
+struct addrspace;
+struct vm_region;
+
+/*
+ * Allocate/free one physical page for user memory; 0 if out of memory.
+ * The page is returned pinned (see coremap.h).
+ */
+paddr_t vm_page_alloc(void);
+void vm_page_free(paddr_t paddr);
+
+/*
+ * Make page VADDR of region VR resident, paging it in if need be, and
+ * pin its frame. *PTE is the page's entry in AS's page table.
+ */
+int vm_page_get(struct addrspace *as, struct vm_region *vr, vaddr_t vaddr,
+		uint32_t *pte);
+
+/*
+ * Free whatever backs page VADDR of region VR of AS, whose page table
+ * entry is *PTE, and clear the entry.
+ */
+void vm_page_discard(struct addrspace *as, struct vm_region *vr,
+		     vaddr_t vaddr, uint32_t *pte);
+
+/*
+ * If page VADDR of the shared file mapping VR is resident and dirty,
+ * write it back to the file.
+ */
+int vm_page_sync(struct vm_region *vr, vaddr_t vaddr, uint32_t *pte);
+
+/*
+ * Do a little background work, such as zeroing free pages, on an idle
+ * CPU. Returns false if there is nothing to do. Does not sleep.
+ */
+bool vm_idle(void);
+
+/* Machine-dependent TLB management (arch/mips/vm/vmtlb.c) */
+void vm_tlb_bootstrap(void);
+int vm_tlb_load(vaddr_t vaddr, uint32_t pte);
+bool vm_tlb_preload(vaddr_t vaddr, const uint32_t *pte);
+void vm_tlb_flush(void);
+void vm_tlb_invalidate(struct addrspace *as, vaddr_t vaddr);
+void vm_tlb_shootdown(struct tlbshootdown *ts, unsigned n);
+void vm_tlb_forget(struct addrspace *as);
+
 
 #endif /* _VM_H_ */
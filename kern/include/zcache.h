@@ -0,0 +1,42 @@
+#ifndef _ZCACHE_H_
+#define _ZCACHE_H_
+
+/*
+ * Compressed in-memory swap cache.
+ *
+ * Dirty pages chosen for eviction are offered here before they are
+ * written to swap. A page whose words are all the same (most often a
+ * page of zeroes) is kept as just that word. Any other page is
+ * run-length coded over words, and kept if it shrinks to half a page
+ * or less. Pages held here cost no disk I/O to evict or to fault back
+ * in, and can be evicted even when there is no swap device.
+ *
+ * Entries are named by a small index, which the page table keeps in
+ * place of a swap slot (PTE_MKZC).
+ */
+
+#include <vm.h>
+
+/* Number of entries; a page table entry has room for 20 bits. */
+#define ZCACHE_NENTRIES  1024
+
+/* "No entry" value */
+#define ZCACHE_NOENTRY   ZCACHE_NENTRIES
+
+/* Most frames the cache will hold compressed pages in. */
+#define ZCACHE_MAXFRAMES 64
+
+/*
+ * Store a copy of the pinned, unmapped frame PADDR, if it compresses.
+ * Returns the entry in *RET, or ENOSPC if it does not compress or
+ * there is no room. Never evicts anything to make room.
+ */
+int zcache_store(paddr_t paddr, unsigned *ret);
+
+/* Decompress entry INDEX into the frame PADDR, and release it. */
+void zcache_load(unsigned index, paddr_t paddr);
+
+/* Release entry INDEX without reading it. */
+void zcache_free(unsigned index);
+
+#endif /* _ZCACHE_H_ */
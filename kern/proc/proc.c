@@ -43,6 +43,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
@@ -50,7 +51,10 @@
 #include <vfs.h>
 #include <synch.h>
 #include <kern/fcntl.h>
+#include <file.h>
+#include <limits.h>
 #include "opt-A2.h"
+#include "opt-vm.h"
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -70,37 +74,237 @@ static struct semaphore *proc_count_mutex;
 struct semaphore *no_proc_sem;
 
 #if OPT_A2
-static struct lock *cur_pid_lock;
-static volatile pid_t cur_pid;
 static bool kernel_initialized;
 #endif
 
 #endif // UW
 
+#if OPT_A2
+/*
+ * Protects the links between parents and children. A process that
+ * exits while its parent is still around stays in the process table,
+ * on its parent's zombies queue, until the parent waits for it.
+ */
+struct lock *proc_family_lock;
+#endif
+
+#if OPT_A2
+/*
+ * The process table, which holds every user process. Slot i holds the
+ * process whose PID is i modulo PROC_TABLESIZE, so finding a process
+ * by PID takes one look. Free slots are kept on a FIFO list, and each
+ * remembers the PID it will hand out next; that goes up by
+ * PROC_TABLESIZE every time the slot is used, wrapping around within
+ * PID_MIN..PID_MAX, so a PID is not handed out again until long after
+ * it has been freed.
+ */
+struct proc_slot
+{
+	struct proc *ps_proc; // NULL if free
+	pid_t ps_pid;		  // PID of ps_proc, or the next one to hand out
+	unsigned ps_next;	  // next slot on the free list
+};
+
+#define PROC_NOSLOT PROC_TABLESIZE
+
+static struct spinlock proctable_lock = SPINLOCK_INITIALIZER;
+static struct proc_slot proctable[PROC_TABLESIZE];
+static unsigned proctable_free;		// first free slot, or PROC_NOSLOT
+static unsigned proctable_freetail; // last free slot
+
+/*
+ * Return the lowest PID that goes in slot SLOT.
+ */
+static pid_t pid_first(unsigned slot)
+{
+	return slot < PID_MIN ? slot + PROC_TABLESIZE : slot;
+}
+
+static void proctable_bootstrap(void)
+{
+	unsigned i;
+
+	for (i = 0; i < PROC_TABLESIZE; i++)
+	{
+		proctable[i].ps_proc = NULL;
+		proctable[i].ps_pid = pid_first(i);
+		proctable[i].ps_next = i + 1;
+	}
+	proctable[PROC_TABLESIZE - 1].ps_next = PROC_NOSLOT;
+	proctable_free = 0;
+	proctable_freetail = PROC_TABLESIZE - 1;
+}
+
 /*
- * Create a proc structure.
+ * Give PROC a PID and enter it in the table. Returns 0 if the table is
+ * full.
  */
-static struct proc *
-proc_create(const char *name)
+static pid_t pid_alloc(struct proc *proc)
 {
+	struct proc_slot *ps;
+	pid_t pid;
+
+	spinlock_acquire(&proctable_lock);
+	if (proctable_free == PROC_NOSLOT)
+	{
+		spinlock_release(&proctable_lock);
+		return 0;
+	}
+	ps = &proctable[proctable_free];
+	proctable_free = ps->ps_next;
+	ps->ps_proc = proc;
+	pid = ps->ps_pid;
+	spinlock_release(&proctable_lock);
+
+	return pid;
+}
+
+/*
+ * Take PID out of the table, putting its slot at the back of the free
+ * list.
+ */
+static void pid_free(pid_t pid)
+{
+	unsigned slot = pid % PROC_TABLESIZE;
+	struct proc_slot *ps = &proctable[slot];
+
+	spinlock_acquire(&proctable_lock);
+	KASSERT(ps->ps_proc != NULL && ps->ps_pid == pid);
+	ps->ps_proc = NULL;
+	ps->ps_pid = pid > PID_MAX - PROC_TABLESIZE ? pid_first(slot) : pid + PROC_TABLESIZE;
+	ps->ps_next = PROC_NOSLOT;
+	if (proctable_free == PROC_NOSLOT)
+	{
+		proctable_free = slot;
+	}
+	else
+	{
+		proctable[proctable_freetail].ps_next = slot;
+	}
+	proctable_freetail = slot;
+	spinlock_release(&proctable_lock);
+}
+
+int proc_findchild(struct proc *parent, pid_t pid, struct proc **ret)
+{
+	struct proc_slot *ps;
+	struct proc *proc;
+	bool ours;
+
+	KASSERT(lock_do_i_hold(proc_family_lock));
+
+	if (pid < PID_MIN || pid > PID_MAX)
+	{
+		return ESRCH;
+	}
+	ps = &proctable[pid % PROC_TABLESIZE];
+
+	/* Someone else's process could be destroyed once we let go. */
+	spinlock_acquire(&proctable_lock);
+	proc = ps->ps_pid == pid ? ps->ps_proc : NULL;
+	ours = proc != NULL && proc->parent == parent;
+	spinlock_release(&proctable_lock);
+
+	if (proc == NULL)
+	{
+		return ESRCH;
+	}
+	if (!ours)
+	{
+		return ECHILD;
+	}
+	*ret = proc;
+	return 0;
+}
+#endif
+
 #if OPT_A2
-	KASSERT(cur_pid > 0);
+/*
+ * Destroyed processes, kept for proc_create to reuse so that forking
+ * doesn't have to allocate them. Each keeps its child_exited cv and
+ * the storage behind its p_threads.
+ */
+#define PROC_CACHESIZE 16
+static struct spinlock proccache_lock = SPINLOCK_INITIALIZER;
+static struct proc *proccache[PROC_CACHESIZE];
+static unsigned proccache_count;
 #endif
+
+/*
+ * Get a proc structure, from the cache if it has one.
+ */
+static struct proc *proc_alloc(void)
+{
 	struct proc *proc;
 
+#if OPT_A2
+	spinlock_acquire(&proccache_lock);
+	proc = proccache_count > 0 ? proccache[--proccache_count] : NULL;
+	spinlock_release(&proccache_lock);
+	if (proc != NULL)
+	{
+		return proc;
+	}
+#endif
+
 	proc = kmalloc(sizeof(*proc));
 	if (proc == NULL)
 	{
 		return NULL;
 	}
-	proc->p_name = kstrdup(name);
-	if (proc->p_name == NULL)
+	threadarray_init(&proc->p_threads);
+#if OPT_A2
+	proc->child_exited = cv_create("child_exited");
+	if (proc->child_exited == NULL)
 	{
+		threadarray_cleanup(&proc->p_threads);
 		kfree(proc);
 		return NULL;
 	}
+#endif
+	return proc;
+}
+
+/*
+ * Give back a proc structure got from proc_alloc.
+ */
+static void proc_free(struct proc *proc)
+{
+#if OPT_A2
+	spinlock_acquire(&proccache_lock);
+	if (proccache_count < PROC_CACHESIZE)
+	{
+		proccache[proccache_count++] = proc;
+		proc = NULL;
+	}
+	spinlock_release(&proccache_lock);
+	if (proc == NULL)
+	{
+		return;
+	}
+	cv_destroy(proc->child_exited);
+#endif
+	threadarray_cleanup(&proc->p_threads);
+	kfree(proc);
+}
+
+/*
+ * Create a proc structure. Returns ENPROC if the process table is full.
+ */
+static int proc_create(const char *name, struct proc **ret)
+{
+	struct proc *proc;
+#if OPT_A2
+	int i;
+#endif
+
+	proc = proc_alloc();
+	if (proc == NULL)
+	{
+		return ENOMEM;
+	}
+	snprintf(proc->p_name, sizeof(proc->p_name), "%s", name);
 
-	threadarray_init(&proc->p_threads);
 	spinlock_init(&proc->p_lock);
 
 	/* VM fields */
@@ -108,32 +312,47 @@ proc_create(const char *name)
 
 	/* VFS fields */
 	proc->p_cwd = NULL;
-	proc->tf = NULL;
 
 #if OPT_A2
-	if (kernel_initialized)
-	{
-		lock_acquire(cur_pid_lock);
-		proc->pid = cur_pid;
-		cur_pid++;
-		lock_release(cur_pid_lock);
-	}
-	else
+	proc->parent = NULL;
+	proc->children = NULL;
+	proc->sibling_next = proc->sibling_prev = NULL;
+	proc->zombies = proc->zombies_tail = NULL;
+	proc->zombie_next = proc->zombie_prev = NULL;
+	proc->exited = false;
+	proc->exit_status = 0;
+	proc->vfork_sem = NULL;
+	for (i = 0; i < OPEN_MAX; i++)
 	{
-		proc->pid = cur_pid;
-		cur_pid++;
+		proc->p_files[i] = NULL;
 	}
-	proc->children_info = array_create();
-	proc->is_dying = cv_create("is_dying");
-	proc->child_lock = lock_create("child_lock");
-	proc->parent = NULL;
 #endif
 
 #ifdef UW
 	proc->console = NULL;
 #endif // UW
 
-	return proc;
+#if OPT_A2
+	/* Last, since it can be found in the table from then on. */
+	if (kernel_initialized)
+	{
+		proc->pid = pid_alloc(proc);
+		if (proc->pid == 0)
+		{
+			spinlock_cleanup(&proc->p_lock);
+			proc_free(proc);
+			return ENPROC;
+		}
+	}
+	else
+	{
+		/* The kernel's PID is not in the table. */
+		proc->pid = PID_MIN - 1;
+	}
+#endif
+
+	*ret = proc;
+	return 0;
 }
 
 /*
@@ -153,9 +372,9 @@ void proc_destroy(struct proc *proc)
 	KASSERT(proc != NULL);
 	KASSERT(proc != kproc);
 
-	/****************************** MEM LEAK HERE FIX THIS *******************************/
-	/* if (proc->tf != NULL) kfree(proc->tf); */
-	/****************************** MEM LEAK HERE FIX THIS *******************************/
+#if OPT_A2
+	pid_free(proc->pid);
+#endif
 
 	/*
 	 * We don't take p_lock in here because we must have the only
@@ -171,20 +390,10 @@ void proc_destroy(struct proc *proc)
 	}
 
 #if OPT_A2
-	// destroy children_info array
-	lock_acquire(proc->child_lock);
-	for (int i = array_num(proc->children_info) - 1; i >= 0; i--)
-	{
-		struct proc_info *pinfo = (struct proc_info *)array_get(proc->children_info, i);
-		pinfo->proc_addr->parent = NULL;
-		kfree(pinfo);
-		array_remove(proc->children_info, i);
-	}
-	array_destroy(proc->children_info);
-	lock_release(proc->child_lock);
-	// destroy is_dying cv and lock on children array
-	cv_destroy(proc->is_dying);
-	lock_destroy(proc->child_lock);
+	/* Its children were let go of when it exited. */
+	KASSERT(proc->children == NULL);
+	/* Only if it never ran; otherwise proc_exit did this. */
+	file_closeall(proc);
 #endif
 
 #ifndef UW // in the UW version, space destruction occurs in sys_exit, not here
@@ -215,11 +424,8 @@ void proc_destroy(struct proc *proc)
 	}
 #endif // UW
 
-	threadarray_cleanup(&proc->p_threads);
 	spinlock_cleanup(&proc->p_lock);
-
-	kfree(proc->p_name);
-	kfree(proc);
+	proc_free(proc);
 
 #ifdef UW
 	/* decrement the process count */
@@ -245,15 +451,14 @@ void proc_bootstrap(void)
 {
 #if OPT_A2
 	kernel_initialized = false;
-	cur_pid = 1;
-	cur_pid_lock = lock_create("cur_pid_lock");
-	if (cur_pid_lock == NULL)
+	proctable_bootstrap();
+	proc_family_lock = lock_create("proc_family");
+	if (proc_family_lock == NULL)
 	{
-		panic("could not create cur_pid_lock lock\n");
+		panic("could not create proc_family_lock\n");
 	}
 #endif
-	kproc = proc_create("[kernel]");
-	if (kproc == NULL)
+	if (proc_create("[kernel]", &kproc))
 	{
 		panic("proc_create for kproc failed\n");
 	}
@@ -274,35 +479,41 @@ void proc_bootstrap(void)
 }
 
 /*
- * Create a fresh proc for use by runprogram.
- *
- * It will have no address space and will inherit the current
- * process's (that is, the kernel menu's) current directory.
+ * Create a user process called NAME. It shares the console vnode
+ * CONSOLE, or opens its own if that is NULL, and inherits the current
+ * process's current directory. It has no address space.
  */
-struct proc *
-proc_create_runprogram(const char *name)
+static int proc_create_user(const char *name, struct vnode *console,
+							struct proc **ret)
 {
 	struct proc *proc;
-	char *console_path;
+	int result;
 
-	proc = proc_create(name);
-	if (proc == NULL)
+	result = proc_create(name, &proc);
+	if (result)
 	{
-		return NULL;
+		return result;
 	}
 
 #ifdef UW
-	/* open the console - this should always succeed */
-	console_path = kstrdup("con:");
-	if (console_path == NULL)
+	if (console != NULL)
 	{
-		panic("unable to copy console path name during process creation\n");
+		/* as if it had opened it itself */
+		VOP_INCOPEN(console);
+		VOP_INCREF(console);
+		proc->console = console;
 	}
-	if (vfs_open(console_path, O_WRONLY, 0, &(proc->console)))
+	else
 	{
-		panic("unable to open the console during process creation\n");
+		/* open the console - this should always succeed */
+		char console_path[] = "con:"; /* vfs_open may change it */
+		if (vfs_open(console_path, O_WRONLY, 0, &(proc->console)))
+		{
+			panic("unable to open the console during process creation\n");
+		}
 	}
-	kfree(console_path);
+#else
+	(void)console;
 #endif // UW
 
 	/* VM fields */
@@ -333,15 +544,45 @@ proc_create_runprogram(const char *name)
 #ifdef UW
 	/* increment the count of processes */
 	/* we are assuming that all procs, including those created by fork(),
-	   are created using a call to proc_create_runprogram  */
+	   are created using a call to proc_create_user  */
 	P(proc_count_mutex);
 	proc_count++;
 	V(proc_count_mutex);
 #endif // UW
 
+	*ret = proc;
+	return 0;
+}
+
+/*
+ * Create a fresh proc for use by runprogram.
+ *
+ * It will have no address space and will inherit the current
+ * process's (that is, the kernel menu's) current directory.
+ */
+struct proc *
+proc_create_runprogram(const char *name)
+{
+	struct proc *proc;
+
+	if (proc_create_user(name, NULL, &proc))
+	{
+		return NULL;
+	}
 	return proc;
 }
 
+#if OPT_A2
+int proc_create_child(struct proc **ret)
+{
+#ifdef UW
+	return proc_create_user(curproc->p_name, curproc->console, ret);
+#else
+	return proc_create_user(curproc->p_name, NULL, ret);
+#endif
+}
+#endif
+
 /*
  * Add a thread to a process. Either the thread or the process might
  * or might not be current.
@@ -446,3 +687,48 @@ proc_setas(struct addrspace *newas, struct proc *proc)
 
 	return oldas;
 }
+
+#if OPT_VM
+/*
+ * Print the resident set size and fault rate of every user process.
+ */
+void proc_printvmstats(void)
+{
+	struct proc *p;
+	struct addrspace *as;
+	unsigned i, rss, faults, rate;
+	char name[32];
+	pid_t pid;
+
+	kprintf("  PID      RSS   Faults  Faults/s  Name\n");
+	for (i = 0; i < PROC_TABLESIZE; i++)
+	{
+		/*
+		 * proctable_lock keeps the process from going away, and
+		 * p_lock its address space from being replaced. Don't
+		 * print while holding them.
+		 */
+		spinlock_acquire(&proctable_lock);
+		p = proctable[i].ps_proc;
+		if (p == NULL)
+		{
+			spinlock_release(&proctable_lock);
+			continue;
+		}
+		pid = p->pid;
+		snprintf(name, sizeof(name), "%s", p->p_name);
+		rss = faults = rate = 0;
+		spinlock_acquire(&p->p_lock);
+		as = p->p_addrspace;
+		if (as != NULL)
+		{
+			as_getstats(as, &rss, &faults, &rate);
+		}
+		spinlock_release(&p->p_lock);
+		spinlock_release(&proctable_lock);
+
+		kprintf("%5d %7uk %8u %9u  %s\n", (int)pid,
+				rss * PAGE_SIZE / 1024, faults, rate, name);
+	}
+}
+#endif
@@ -50,6 +50,10 @@
 #include <test.h>
 #include <version.h>
 #include "autoconf.h" // for pseudoconfig
+#include "opt-vm.h"
+#if OPT_VM
+#include <uw-vmstats.h>
+#endif
 
 /*
  * These two pieces of data are maintained by the makefiles and build system.
@@ -141,6 +145,9 @@ shutdown(void)
 {
 
 	kprintf("Shutting down.\n");
+#if OPT_VM
+	vmstats_print();
+#endif
 
 	vfs_clearbootfs();
 	vfs_clearcurdir();
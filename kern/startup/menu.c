@@ -42,9 +42,11 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <coremap.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-vm.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -414,10 +416,26 @@ cmd_kheapstats(int nargs, char **args)
 	(void)args;
 
 	kheap_printstats();
+#if OPT_VM
+	coremap_printstats();
+#endif
 
 	return 0;
 }
 
+#if OPT_VM
+static int
+cmd_wsstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	proc_printvmstats();
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -484,6 +502,9 @@ static const char *testmenu[] = {
 	"[tt3] Thread test 3                 ",
 #if OPT_NET
 	"[net] Network test                  ",
+#endif
+#if OPT_VM
+	"[cm]  Coremap test                  ",
 #endif
 	"[sy1] Semaphore test                ",
 	"[sy2] Lock test             (1)     ",
@@ -526,6 +547,9 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+#if OPT_VM
+	"[ws] Process working sets           ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL};
 
@@ -582,6 +606,9 @@ static struct
 
 	/* stats */
 	{"kh", cmd_kheapstats},
+#if OPT_VM
+	{"ws", cmd_wsstats},
+#endif
 
 	/* base system tests */
 	{"at", arraytest},
@@ -590,6 +617,9 @@ static struct
 	{"km2", mallocstress},
 #if OPT_NET
 	{"net", nettest},
+#endif
+#if OPT_VM
+	{"cm", coremaptest},
 #endif
 	{"tt1", threadtest},
 	{"tt2", threadtest2},
@@ -1,23 +1,241 @@
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
 #include <kern/unistd.h>
 #include <lib.h>
 #include <uio.h>
+#include <stat.h>
+#include <synch.h>
+#include <copyinout.h>
 #include <syscall.h>
 #include <vnode.h>
 #include <vfs.h>
 #include <current.h>
 #include <proc.h>
+#include <file.h>
+#include "opt-A2.h"
+
+#if OPT_A2
+int
+file_get(int fd, struct openfile **ret)
+{
+  if (fd < FILE_FIRSTFD || fd >= OPEN_MAX || curproc->p_files[fd] == NULL) {
+    return EBADF;
+  }
+  *ret = curproc->p_files[fd];
+  return 0;
+}
+
+/* drop a descriptor's reference to OF, closing it if it was the last */
+static
+void
+file_decref(struct openfile *of)
+{
+  unsigned refs;
+
+  lock_acquire(of->of_lock);
+  KASSERT(of->of_refcount > 0);
+  refs = --of->of_refcount;
+  lock_release(of->of_lock);
+
+  if (refs == 0) {
+    vfs_close(of->of_vnode);
+    lock_destroy(of->of_lock);
+    kfree(of);
+  }
+}
+
+void
+file_inherit(struct proc *child)
+{
+  struct openfile *of;
+  int fd;
+
+  for (fd = FILE_FIRSTFD; fd < OPEN_MAX; fd++) {
+    of = curproc->p_files[fd];
+    KASSERT(child->p_files[fd] == NULL);
+    if (of != NULL) {
+      lock_acquire(of->of_lock);
+      of->of_refcount++;
+      lock_release(of->of_lock);
+      child->p_files[fd] = of;
+    }
+  }
+}
+
+void
+file_closeall(struct proc *p)
+{
+  int fd;
+
+  for (fd = FILE_FIRSTFD; fd < OPEN_MAX; fd++) {
+    if (p->p_files[fd] != NULL) {
+      file_decref(p->p_files[fd]);
+      p->p_files[fd] = NULL;
+    }
+  }
+}
+
+/*
+ * Read or write LEN bytes at BUF from or to the open file FD, at its
+ * offset, and move the offset past them.
+ */
+static
+int
+file_rw(int fd, userptr_t buf, size_t len, enum uio_rw rw, int *retval)
+{
+  struct openfile *of;
+  struct iovec iov;
+  struct uio u;
+  struct stat st;
+  int accmode, res;
+
+  res = file_get(fd, &of);
+  if (res) {
+    return res;
+  }
+  accmode = of->of_flags & O_ACCMODE;
+  if (rw == UIO_READ ? accmode == O_WRONLY : accmode == O_RDONLY) {
+    return EBADF;
+  }
+
+  lock_acquire(of->of_lock);
+  if (rw == UIO_WRITE && (of->of_flags & O_APPEND)) {
+    res = VOP_STAT(of->of_vnode, &st);
+    if (res) {
+      lock_release(of->of_lock);
+      return res;
+    }
+    of->of_offset = st.st_size;
+  }
+
+  iov.iov_ubase = buf;
+  iov.iov_len = len;
+  u.uio_iov = &iov;
+  u.uio_iovcnt = 1;
+  u.uio_offset = of->of_offset;
+  u.uio_resid = len;
+  u.uio_segflg = UIO_USERSPACE;
+  u.uio_rw = rw;
+  u.uio_space = curproc->p_addrspace;
+
+  res = rw == UIO_READ ? VOP_READ(of->of_vnode, &u) :
+    VOP_WRITE(of->of_vnode, &u);
+  if (res == 0) {
+    of->of_offset = u.uio_offset;
+    *retval = len - u.uio_resid;
+  }
+  lock_release(of->of_lock);
+  return res;
+}
+
+/*
+ * open: open the file at PATH with the O_ flags FLAGS, creating it
+ * with MODE if need be, on the lowest free descriptor.
+ */
+int
+sys_open(userptr_t path, int flags, mode_t mode, int *retval)
+{
+  struct openfile *of;
+  struct vnode *v;
+  char *kpath;
+  int fd, res;
+
+  if ((flags & ~(O_ACCMODE | O_CREAT | O_EXCL | O_TRUNC | O_APPEND |
+                 O_NOCTTY)) != 0 ||
+      (flags & O_ACCMODE) == O_ACCMODE) {
+    return EINVAL;
+  }
+
+  for (fd = FILE_FIRSTFD; fd < OPEN_MAX; fd++) {
+    if (curproc->p_files[fd] == NULL) {
+      break;
+    }
+  }
+  if (fd == OPEN_MAX) {
+    return EMFILE;
+  }
+
+  of = kmalloc(sizeof(struct openfile));
+  if (of == NULL) {
+    return ENOMEM;
+  }
+  of->of_lock = lock_create("openfile");
+  kpath = kmalloc(PATH_MAX);
+  if (of->of_lock == NULL || kpath == NULL) {
+    res = ENOMEM;
+    goto fail;
+  }
+
+  res = copyinstr(path, kpath, PATH_MAX, NULL);
+  if (res) {
+    goto fail;
+  }
+  /* vfs_open may change kpath */
+  res = vfs_open(kpath, flags, mode, &v);
+  if (res) {
+    goto fail;
+  }
+  kfree(kpath);
+
+  of->of_vnode = v;
+  of->of_flags = flags;
+  of->of_offset = 0;
+  of->of_refcount = 1;
+  curproc->p_files[fd] = of;
+
+  *retval = fd;
+  return 0;
+
+ fail:
+  if (kpath != NULL) {
+    kfree(kpath);
+  }
+  if (of->of_lock != NULL) {
+    lock_destroy(of->of_lock);
+  }
+  kfree(of);
+  return res;
+}
+
+int
+sys_close(int fd)
+{
+  struct openfile *of;
+  int res;
+
+  res = file_get(fd, &of);
+  if (res) {
+    return res;
+  }
+  curproc->p_files[fd] = NULL;
+  file_decref(of);
+  return 0;
+}
+
+/*
+ * read: as for write, the console's descriptors are not supported.
+ */
+int
+sys_read(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval)
+{
+  DEBUG(DB_SYSCALL,"Syscall: read(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+
+  if (fdesc < FILE_FIRSTFD) {
+    return EUNIMP;
+  }
+  return file_rw(fdesc, ubuf, nbytes, UIO_READ, retval);
+}
+#endif /* OPT_A2 */
 
 /* handler for write() system call                  */
 /*
  * n.b.
- * This implementation handles only writes to standard output 
- * and standard error, both of which go to the console.
- * Also, it does not provide any synchronization, so writes
+ * This implementation handles writes to standard output and standard
+ * error, both of which go to the console, and (with OPT_A2) to files
+ * opened with open.
+ * Also, it does not provide any synchronization, so console writes
  * are not atomic.
- *
- * You will need to improve this implementation
  */
 
 int
@@ -28,7 +246,12 @@ sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
   int res;
 
   DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
-  
+
+#if OPT_A2
+  if (fdesc >= FILE_FIRSTFD) {
+    return file_rw(fdesc, ubuf, nbytes, UIO_WRITE, retval);
+  }
+#endif
   /* only stdout and stderr writes are currently implemented */
   if (!((fdesc==STDOUT_FILENO)||(fdesc==STDERR_FILENO))) {
     return EUNIMP;
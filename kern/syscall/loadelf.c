@@ -59,6 +59,11 @@
 #include <addrspace.h>
 #include <vnode.h>
 #include <elf.h>
+#include "opt-vm.h"
+#if OPT_VM
+#include <textcache.h>
+#include <execcache.h>
+#endif
 
 /*
  * Load a segment at virtual address VADDR. The segment in memory
@@ -74,6 +79,7 @@
  * change this code to not use uiomove, be sure to check for this case
  * explicitly.
  */
+#if !OPT_VM
 static
 int
 load_segment(struct addrspace *as, struct vnode *v,
@@ -144,6 +150,174 @@ load_segment(struct addrspace *as, struct vnode *v,
 	
 	return result;
 }
+#endif /* !OPT_VM */
+
+#if OPT_VM
+/*
+ * Read and check the headers of executable V, and fill in IMAGE from
+ * them.
+ */
+static
+int
+load_image(struct vnode *v, struct execcache_image *image)
+{
+	Elf_Ehdr eh;   /* Executable header */
+	Elf_Phdr ph;   /* "Program header" = segment header */
+	struct execcache_seg *es;
+	int result, i;
+	struct iovec iov;
+	struct uio ku;
+
+	/*
+	 * Read the executable header from offset 0 in the file.
+	 */
+
+	uio_kinit(&iov, &ku, &eh, sizeof(eh), 0, UIO_READ);
+	result = VOP_READ(v, &ku);
+	if (result) {
+		return result;
+	}
+
+	if (ku.uio_resid != 0) {
+		/* short read; problem with executable? */
+		kprintf("ELF: short read on header - file truncated?\n");
+		return ENOEXEC;
+	}
+
+	/*
+	 * Check to make sure it's a 32-bit ELF-version-1 executable
+	 * for our processor type. If it's not, we can't run it.
+	 */
+
+	if (eh.e_ident[EI_MAG0] != ELFMAG0 ||
+	    eh.e_ident[EI_MAG1] != ELFMAG1 ||
+	    eh.e_ident[EI_MAG2] != ELFMAG2 ||
+	    eh.e_ident[EI_MAG3] != ELFMAG3 ||
+	    eh.e_ident[EI_CLASS] != ELFCLASS32 ||
+	    eh.e_ident[EI_DATA] != ELFDATA2MSB ||
+	    eh.e_ident[EI_VERSION] != EV_CURRENT ||
+	    eh.e_version != EV_CURRENT ||
+	    eh.e_type!=ET_EXEC ||
+	    eh.e_machine!=EM_MACHINE) {
+		return ENOEXEC;
+	}
+
+	image->ei_entry = eh.e_entry;
+	image->ei_nsegs = 0;
+
+	for (i=0; i<eh.e_phnum; i++) {
+		off_t offset = eh.e_phoff + i*eh.e_phentsize;
+		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
+
+		result = VOP_READ(v, &ku);
+		if (result) {
+			return result;
+		}
+
+		if (ku.uio_resid != 0) {
+			/* short read; problem with executable? */
+			kprintf("ELF: short read on phdr - file truncated?\n");
+			return ENOEXEC;
+		}
+
+		switch (ph.p_type) {
+		    case PT_NULL: /* skip */ continue;
+		    case PT_PHDR: /* skip */ continue;
+		    case PT_MIPS_REGINFO: /* skip */ continue;
+		    case PT_LOAD: break;
+		    default:
+			kprintf("loadelf: unknown segment type %d\n", 
+				ph.p_type);
+			return ENOEXEC;
+		}
+
+		if (image->ei_nsegs == EXECCACHE_MAXSEGS) {
+			kprintf("loadelf: more than %d segments\n",
+				EXECCACHE_MAXSEGS);
+			return ENOEXEC;
+		}
+		if (ph.p_filesz > ph.p_memsz) {
+			kprintf("ELF: warning: segment filesize > segment memsize\n");
+			ph.p_filesz = ph.p_memsz;
+		}
+
+		es = &image->ei_segs[image->ei_nsegs++];
+		es->es_offset = ph.p_offset;
+		es->es_vaddr = ph.p_vaddr;
+		es->es_memsz = ph.p_memsz;
+		es->es_filesz = ph.p_filesz;
+		es->es_flags = ph.p_flags;
+	}
+
+	return 0;
+}
+
+/*
+ * Load an ELF executable user program into the current address space.
+ *
+ * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ *
+ * The headers are only read the first time a program is run; after
+ * that, what they say comes from the exec image cache. Segments are
+ * paged in from V on first touch.
+ */
+int
+load_elf(struct vnode *v, vaddr_t *entrypoint)
+{
+	struct execcache_image image;
+	struct execcache_seg *es;
+	struct addrspace *as;
+	unsigned i, gen;
+	int result;
+
+	as = curproc_getas();
+
+	if (!execcache_lookup(v, &image)) {
+		gen = textcache_gen(v);
+		result = load_image(v, &image);
+		if (result) {
+			return result;
+		}
+		execcache_enter(v, &image, gen);
+	}
+
+	for (i=0; i<image.ei_nsegs; i++) {
+		es = &image.ei_segs[i];
+		result = as_define_region(as,
+					  es->es_vaddr, es->es_memsz,
+					  es->es_flags & PF_R,
+					  es->es_flags & PF_W,
+					  es->es_flags & PF_X);
+		if (result) {
+			return result;
+		}
+	}
+
+	result = as_prepare_load(as);
+	if (result) {
+		return result;
+	}
+
+	for (i=0; i<image.ei_nsegs; i++) {
+		es = &image.ei_segs[i];
+		result = as_define_filedata(as, v, es->es_offset,
+					    es->es_vaddr, es->es_filesz);
+		if (result) {
+			return result;
+		}
+	}
+
+	result = as_complete_load(as);
+	if (result) {
+		return result;
+	}
+
+	*entrypoint = image.ei_entry;
+
+	return 0;
+}
+
+#else /* !OPT_VM */
 
 /*
  * Load an ELF executable user program into the current address space.
@@ -305,3 +479,5 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 
 	return 0;
 }
+
+#endif /* OPT_VM */
@@ -2,6 +2,7 @@
 #include <kern/errno.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
+#include <limits.h>
 #include <lib.h>
 #include <syscall.h>
 #include <current.h>
@@ -13,41 +14,143 @@
 #include <mips/trapframe.h>
 #include <vfs.h>
 #include <kern/fcntl.h>
+#include <file.h>
 #endif
 #include "opt-A2.h"
 
-/* this implementation of sys__exit does not do anything with the exit code */
-/* this needs to be fixed to get exit() and waitpid() working properly */
+#if OPT_A2
+/*
+ * The family links. All of these are called with proc_family_lock held.
+ */
+static void child_link(struct proc *parent, struct proc *child)
+{
+  child->parent = parent;
+  child->sibling_prev = NULL;
+  child->sibling_next = parent->children;
+  if (parent->children != NULL)
+  {
+    parent->children->sibling_prev = child;
+  }
+  parent->children = child;
+}
 
-void sys__exit(int exitcode)
+static void child_unlink(struct proc *parent, struct proc *child)
 {
+  if (child->sibling_prev != NULL)
+  {
+    child->sibling_prev->sibling_next = child->sibling_next;
+  }
+  else
+  {
+    parent->children = child->sibling_next;
+  }
+  if (child->sibling_next != NULL)
+  {
+    child->sibling_next->sibling_prev = child->sibling_prev;
+  }
+  child->parent = NULL;
+}
 
-  struct addrspace *as;
-  struct proc *p = curproc;
-  /* for now, just include this to keep the compiler from complaining about
-     an unused variable */
-#if OPT_A2
-  if (curproc->parent != NULL)
+static void zombie_enqueue(struct proc *parent, struct proc *child)
+{
+  child->zombie_next = NULL;
+  child->zombie_prev = parent->zombies_tail;
+  if (parent->zombies_tail != NULL)
   {
-    lock_acquire(curproc->parent->child_lock);
-    for (unsigned int i = 0; i < array_num(curproc->parent->children_info); i++)
-    {
-      struct proc_info *p_info = array_get(curproc->parent->children_info, i);
-      if (curproc->pid == p_info->pid)
-      {
-        p_info->exit_code = exitcode;
-        break;
-      }
-    }
-    lock_release(curproc->parent->child_lock);
-    cv_signal(curproc->is_dying, curproc->child_lock);
+    parent->zombies_tail->zombie_next = child;
   }
-#else
-  (void)exitcode;
+  else
+  {
+    parent->zombies = child;
+  }
+  parent->zombies_tail = child;
+}
+
+static void zombie_dequeue(struct proc *parent, struct proc *child)
+{
+  if (child->zombie_prev != NULL)
+  {
+    child->zombie_prev->zombie_next = child->zombie_next;
+  }
+  else
+  {
+    parent->zombies = child->zombie_next;
+  }
+  if (child->zombie_next != NULL)
+  {
+    child->zombie_next->zombie_prev = child->zombie_prev;
+  }
+  else
+  {
+    parent->zombies_tail = child->zombie_prev;
+  }
+}
+
+/*
+ * Create a child of the current process, with no address space yet.
+ */
+static int fork_child(struct proc **ret)
+{
+  struct proc *child;
+  int err = proc_create_child(&child);
+  if (err)
+  {
+    return err;
+  }
+  KASSERT(child->pid > 0);
+
+  file_inherit(child);
+
+  lock_acquire(proc_family_lock);
+  child_link(curproc, child);
+  lock_release(proc_family_lock);
+
+  *ret = child;
+  return 0;
+}
+
+/*
+ * Undo fork_child, for a child that never got to run.
+ */
+static void fork_undo(struct proc *child)
+{
+  lock_acquire(proc_family_lock);
+  child_unlink(curproc, child);
+  lock_release(proc_family_lock);
+  proc_destroy(child);
+}
+
+/*
+ * If P is a vforked child, give the address space it borrowed back to
+ * its parent, which is waiting for it. Returns true if it did; P's
+ * address space must already have been taken off it.
+ */
+static bool vfork_release(struct proc *p)
+{
+  struct semaphore *done = p->vfork_sem;
+
+  if (done == NULL)
+  {
+    return false;
+  }
+  p->vfork_sem = NULL;
+  V(done);
+  return true;
+}
 #endif
 
+void sys__exit(int exitcode)
+{
   DEBUG(DB_SYSCALL, "Syscall: _exit(%d)\n", exitcode);
 
+#if OPT_A2
+  proc_exit(_MKWAIT_EXIT(exitcode));
+#else
+  struct addrspace *as;
+  struct proc *p = curproc;
+
+  (void)exitcode;
+
   KASSERT(curproc->p_addrspace != NULL);
   as_deactivate();
   /*
@@ -71,7 +174,86 @@ void sys__exit(int exitcode)
   thread_exit();
   /* thread_exit() does not return, so we should never get here */
   panic("return from thread_exit in sys_exit\n");
+#endif
+}
+
+#if OPT_A2
+/*
+ * Exit the current process with wait status STATUS. If its parent is
+ * still around, it goes on the parent's zombies queue, keeping its PID
+ * and status until the parent waits for it; otherwise it is destroyed
+ * here. Its own exited children are destroyed, and the rest let go of,
+ * so that they destroy themselves when they exit.
+ */
+void proc_exit(int status)
+{
+  struct addrspace *as;
+  struct proc *p = curproc;
+  struct proc *child, *reap;
+  bool zombie;
+
+  KASSERT(curproc->p_addrspace != NULL);
+  as_deactivate();
+  /*
+   * clear p_addrspace before calling as_destroy. Otherwise if
+   * as_destroy sleeps (which is quite possible) when we
+   * come back we'll be calling as_activate on a
+   * half-destroyed address space. This tends to be
+   * messily fatal.
+   */
+  as = curproc_setas(NULL);
+  if (!vfork_release(p))
+  {
+    as_destroy(as);
+  }
+  file_closeall(p);
+
+  /* detach this thread from its process */
+  /* note: curproc cannot be used after this call */
+  proc_remthread(curthread);
+
+  lock_acquire(proc_family_lock);
+  reap = NULL;
+  while ((child = p->children) != NULL)
+  {
+    child_unlink(p, child);
+    if (child->exited)
+    {
+      zombie_dequeue(p, child);
+      child->sibling_next = reap;
+      reap = child;
+    }
+  }
+  zombie = p->parent != NULL;
+  if (zombie)
+  {
+    p->exited = true;
+    p->exit_status = status;
+    zombie_enqueue(p->parent, p);
+    cv_broadcast(p->parent->child_exited, proc_family_lock);
+  }
+  lock_release(proc_family_lock);
+  // once the lock is let go of, our parent may destroy us at any time
+
+  while (reap != NULL)
+  {
+    child = reap;
+    reap = child->sibling_next;
+    proc_destroy(child);
+  }
+
+  /* if this is the last user process in the system, proc_destroy()
+     will wake up the kernel menu thread */
+  if (!zombie)
+  {
+    proc_destroy(p);
+  }
+
+  thread_exit();
+  /* thread_exit() does not return, so we should never get here */
+  panic("return from thread_exit in proc_exit\n");
 }
+#endif
 
 /* stub handler for getpid() system call                */
 int sys_getpid(pid_t *retval)
@@ -86,8 +268,11 @@ int sys_getpid(pid_t *retval)
   return (0);
 }
 
-/* stub handler for waitpid() system call                */
-
+/*
+ * waitpid: PID is a child's PID, or -1 for whichever child exits
+ * first. With WNOHANG, return 0 instead of waiting if it has not
+ * exited yet.
+ */
 int sys_waitpid(pid_t pid,
                 userptr_t status,
                 int options,
@@ -96,47 +281,78 @@ int sys_waitpid(pid_t pid,
   int exitstatus;
   int result;
 
-  /* this is just a stub implementation that always reports an
-     exit status of 0, regardless of the actual exit status of
-     the specified process.
-     In fact, this will return 0 even if the specified process
-     is still running, and even if it never existed in the first place.
-
-     Fix this!
-  */
-
-  if (options != 0)
+  if (options & ~WNOHANG)
   {
     return (EINVAL);
   }
-  /* for now, just pretend the exitstatus is 0 */
 #if OPT_A2
-  lock_acquire(curproc->child_lock);
-  bool exists = false;
-  for (unsigned int i = 0; i < array_num(curproc->children_info); i++)
+  struct proc *child, *target = NULL;
+
+  // no process groups
+  if (pid == 0 || pid < -1)
+  {
+    return (EINVAL);
+  }
+
+  lock_acquire(proc_family_lock);
+  if (pid == -1)
   {
-    struct proc_info *pinfo = array_get(curproc->children_info, i);
-    if (pid == pinfo->pid)
+    result = curproc->children == NULL ? ECHILD : 0;
+  }
+  else
+  {
+    result = proc_findchild(curproc, pid, &target);
+  }
+  if (result)
+  {
+    lock_release(proc_family_lock);
+    return (result);
+  }
+
+  for (;;)
+  {
+    if (pid == -1)
     {
-      exists = true;
-      struct proc_info *child = array_get(curproc->children_info, i);
-      while (child->exit_code == -1)
-      {
-        cv_wait(child->proc_addr->is_dying, curproc->child_lock);
-      }
-      exitstatus = _MKWAIT_EXIT(child->exit_code);
+      child = curproc->zombies;
+    }
+    else
+    {
+      child = target->exited ? target : NULL;
+    }
+    if (child != NULL)
+    {
+      break;
     }
+    if (options & WNOHANG)
+    {
+      lock_release(proc_family_lock);
+      *retval = 0;
+      return (0);
+    }
+    cv_wait(curproc->child_exited, proc_family_lock);
   }
-  if (!exists)
+
+  // if the status can't be stored, leave the child to be waited for again
+  exitstatus = child->exit_status;
+  if (status != NULL)
   {
-    lock_release(curproc->child_lock);
-    *retval = -1;
-    return (ESRCH);
+    result = copyout((void *)&exitstatus, status, sizeof(int));
+    if (result)
+    {
+      lock_release(proc_family_lock);
+      return (result);
+    }
   }
-  lock_release(curproc->child_lock);
+  zombie_dequeue(curproc, child);
+  child_unlink(curproc, child);
+  lock_release(proc_family_lock);
+
+  *retval = child->pid;
+  proc_destroy(child);
+  return (0);
 #else
+  /* for now, just pretend the exitstatus is 0 */
   exitstatus = 0;
-#endif
   result = copyout((void *)&exitstatus, status, sizeof(int));
   if (result)
   {
@@ -144,98 +360,183 @@ int sys_waitpid(pid_t pid,
   }
   *retval = pid;
   return (0);
+#endif
 }
 
 int sys_fork(struct trapframe *tf, pid_t *retval)
 {
   // create child proc
-  struct proc *child = proc_create_runprogram(curproc->p_name); // perhaps we want a diff name for child
-  KASSERT(child != NULL);
-  KASSERT(child->pid > 0);
+  struct proc *child;
+  int err = fork_child(&child);
+  if (err)
+  {
+    return err;
+  }
 
-  // set parent pointer
-  child->parent = curproc;
+  // copy over address space
+  struct addrspace *as;
+  err = as_copy(curproc_getas(), &as);
+  if (err)
+  {
+    fork_undo(child);
+    return err;
+  }
+  proc_setas(as, child);
 
-  // add to children_info array
-  struct proc_info *child_info = kmalloc(sizeof(struct proc_info));
-  child_info->proc_addr = child;
-  child_info->exit_code = -1;
-  child_info->pid = child->pid;
-  array_add(curproc->children_info, child_info, NULL);
+  // the child gets its own copy of tf, on its kernel stack
+  pid_t pid = child->pid;
+  err = thread_fork_copy(child->p_name, child, (void *)&enter_forked_process,
+                         tf, sizeof(struct trapframe), 0);
+  if (err)
+  {
+    proc_setas(NULL, child);
+    fork_undo(child);
+    as_destroy(as);
+    return err;
+  }
 
-  // copy over address space
-  int err = as_copy(curproc_getas(), &(child->p_addrspace));
-  if (err != 0)
-    panic("copy address space errored");
-  // probably don't need this function since we are directly copying address space into child
-  // address space
-  /* proc_setas(child->p_addrspace, child); */
+  *retval = pid;
+  return (0);
+}
 
-  // create temp trapframe
-  curproc->tf = kmalloc(sizeof(struct trapframe));
-  KASSERT(curproc->tf != NULL);
-  memcpy(curproc->tf, tf, sizeof(struct trapframe));
+/*
+ * vfork: like fork, but the child borrows our address space instead of
+ * getting a copy, and we sleep until it gives it back by calling execv
+ * or _exit.
+ */
+int sys_vfork(struct trapframe *tf, pid_t *retval)
+{
+  struct proc *child;
+  int err = fork_child(&child);
+  if (err)
+  {
+    return err;
+  }
+  pid_t pid = child->pid;
 
-  // fork thread with temp trapframe
-  thread_fork(child->p_name, child, (void *)&enter_forked_process, curproc->tf, 10);
+  struct semaphore *done = sem_create("vfork", 0);
+  if (done == NULL)
+  {
+    fork_undo(child);
+    return ENOMEM;
+  }
+  child->vfork_sem = done;
+  proc_setas(curproc_getas(), child);
 
-  *retval = child->pid;
+  // the child copies tf before it can wake us, so it can stay on our stack
+  err = thread_fork(child->p_name, child, (void *)&enter_forked_process, tf, 0);
+  if (err)
+  {
+    proc_setas(NULL, child);
+    fork_undo(child);
+    sem_destroy(done);
+    return err;
+  }
 
+  P(done);
+  sem_destroy(done);
+
+  *retval = pid;
   return (0);
 }
 
-int sys_execv(const char *program_name, char **args)
+/*
+ * Program arguments for execv and spawn, as copied in by
+ * copyin_program. Everything lives in one buffer of ARG_MAX bytes: the
+ * program name, then from a word boundary the argument strings packed
+ * end to end. That buffer is also where the image of the new stack's
+ * argument area is made, with the argv array after the strings, so it
+ * can go out in one copyout.
+ */
+struct exec_args
 {
-  struct addrspace *as;
-  struct vnode *v;
-  vaddr_t entrypoint, stackptr;
-  int result;
-  (void)args;
+  char *buf;     // ARG_MAX bytes, starting with the program name
+  char *strings; // the argument strings
+  size_t len;    // bytes of strings, counting the NULs
+  int argc;
+};
 
-  // copy over program name into kernel space
-  size_t program_name_size = (strlen(program_name) + 1) * sizeof(char);
-  char *program_name_kernel = kmalloc(program_name_size);
-  KASSERT(program_name_kernel != NULL);
-  int err = copyin((const_userptr_t)program_name, (void *)program_name_kernel, program_name_size);
-  KASSERT(err == 0);
+static int copyin_program(const char *program_name, char **args, struct exec_args *ea)
+{
+  size_t got, room, need;
+  userptr_t arg;
+  int result;
 
-  // count number of args and copy into kernel
-  int num_args = 0;
-  for (int i = 0; args[i] != NULL; i++)
+  ea->buf = kmalloc(ARG_MAX);
+  if (ea->buf == NULL)
   {
-    num_args++;
+    return ENOMEM;
   }
 
-  // copy program args into kernel
-  size_t args_array_size = (num_args + 1) * sizeof(char *);
-  char **args_kernel = kmalloc(args_array_size);
-  KASSERT(args_kernel != NULL);
+  result = copyinstr((const_userptr_t)program_name, ea->buf, PATH_MAX, &got);
+  if (result)
+  {
+    kfree(ea->buf);
+    return result;
+  }
+  ea->strings = ea->buf + ROUNDUP(got, sizeof(userptr_t));
+  ea->len = 0;
+  ea->argc = 0;
+  room = ARG_MAX - (ea->strings - ea->buf);
 
-  for (int i = 0; i <= num_args; i++)
+  for (;;)
   {
-    if (i == num_args)
+    result = copyin((const_userptr_t)&args[ea->argc], &arg, sizeof(arg));
+    if (result || arg == NULL)
     {
-      args_kernel[i] = NULL;
+      break;
     }
-    else
+
+    // leave room for padding and the argv array, with this one and the NULL
+    need = ea->len + (sizeof(userptr_t) - 1) + (ea->argc + 2) * sizeof(userptr_t);
+    if (need >= room)
     {
-      size_t arg_size = (strlen(args[i]) + 1) * sizeof(char);
-      args_kernel[i] = kmalloc(arg_size);
-      KASSERT(args_kernel[i] != NULL);
-      int err = copyin((const_userptr_t)args[i], (void *)args_kernel[i], arg_size);
-      KASSERT(err == 0);
+      result = E2BIG;
+      break;
     }
+    result = copyinstr(arg, ea->strings + ea->len, room - need, &got);
+    if (result)
+    {
+      if (result == ENAMETOOLONG)
+      {
+        result = E2BIG;
+      }
+      break;
+    }
+    ea->len += got;
+    ea->argc++;
   }
 
-  /* Open the file. */
-  result = vfs_open(program_name_kernel, O_RDONLY, 0, &v);
   if (result)
   {
+    kfree(ea->buf);
     return result;
   }
+  return 0;
+}
+
+/*
+ * Load the program named in EA into a new address space, which is left
+ * current, and put its arguments on the stack. The old address space
+ * is handed back in *RET_OLDAS, and argv, the initial stack pointer and
+ * the entry point in *RET_ARGV, *RET_STACKPTR and *RET_ENTRYPOINT. On
+ * error the old address space is put back. EA's buffer is overwritten.
+ */
+static int load_program(struct exec_args *ea, struct addrspace **ret_oldas,
+                        userptr_t *ret_argv, vaddr_t *ret_stackptr,
+                        vaddr_t *ret_entrypoint)
+{
+  struct addrspace *as;
+  struct vnode *v;
+  vaddr_t entrypoint, stackptr;
+  int result;
 
-  /* We should be a new process. */
-  /* KASSERT(curproc_getas() == NULL); */
+  /* Open the file. */
+  result = vfs_open(ea->buf, O_RDONLY, 0, &v);
+  if (result)
+  {
+    return result;
+  }
 
   /* Create a new address space. */
   as = as_create();
@@ -251,61 +552,161 @@ int sys_execv(const char *program_name, char **args)
 
   /* Load the executable. */
   result = load_elf(v, &entrypoint);
+
+  /* Done with the file now. */
+  vfs_close(v);
+
+  /* Define the user stack in the address space */
+  if (result == 0)
+  {
+    result = as_define_stack(as, &stackptr);
+  }
+
   if (result)
   {
-    /* p_addrspace will go away when curproc is destroyed */
-    vfs_close(v);
+    curproc_setas(as_old);
+    as_activate();
+    as_destroy(as);
     return result;
   }
 
-  /* Done with the file now. */
-  vfs_close(v);
+  // the strings go at the top of the stack with the argv array above
+  // them; copyin_program left room for it
+  size_t argv_offset = ROUNDUP(ea->len, sizeof(userptr_t));
+  size_t size = argv_offset + (ea->argc + 1) * sizeof(userptr_t);
+  vaddr_t base = stackptr - ROUNDUP(size, 8);
+  userptr_t *argv = (userptr_t *)(ea->strings + argv_offset);
+  char *arg = ea->strings;
 
-  /* Define the user stack in the address space */
-  result = as_define_stack(as, &stackptr);
+  bzero(ea->strings + ea->len, argv_offset - ea->len);
+  for (int i = 0; i < ea->argc; i++)
+  {
+    argv[i] = (userptr_t)(base + (arg - ea->strings));
+    arg += strlen(arg) + 1;
+  }
+  argv[ea->argc] = NULL;
+
+  result = copyout(ea->strings, (userptr_t)base, size);
   if (result)
   {
-    /* p_addrspace will go away when curproc is destroyed */
+    curproc_setas(as_old);
+    as_activate();
+    as_destroy(as);
     return result;
   }
 
-  // HARD PART: COPY ARGS TO USER STACK
-  vaddr_t temp_stack_ptr = stackptr;
-  vaddr_t *stack_args = kmalloc((num_args + 1) * sizeof(vaddr_t));
+  *ret_oldas = as_old;
+  *ret_argv = (userptr_t)(base + argv_offset);
+  *ret_stackptr = base;
+  *ret_entrypoint = entrypoint;
+  return 0;
+}
 
-  for (int i = num_args; i >= 0; i--)
+int sys_execv(const char *program_name, char **args)
+{
+  struct exec_args ea;
+  struct addrspace *as_old;
+  userptr_t argv;
+  vaddr_t entrypoint, stackptr;
+  int result;
+
+  result = copyin_program(program_name, args, &ea);
+  if (result)
   {
-    if (i == num_args)
-    {
-      stack_args[i] = (vaddr_t)NULL;
-      continue;
-    }
-    size_t arg_length = ROUNDUP(strlen(args_kernel[i]) + 1, 4);
-    size_t arg_size = arg_length * sizeof(char);
-    temp_stack_ptr -= arg_size;
-    int err = copyout((void *)args_kernel[i], (userptr_t)temp_stack_ptr, arg_length);
-    KASSERT(err == 0);
-    stack_args[i] = temp_stack_ptr;
+    return result;
   }
 
-  for (int i = num_args; i >= 0; i--)
+  result = load_program(&ea, &as_old, &argv, &stackptr, &entrypoint);
+  kfree(ea.buf);
+  if (result)
   {
-    size_t str_pointer_size = sizeof(vaddr_t);
-    temp_stack_ptr -= str_pointer_size;
-    int err = copyout((void *)&stack_args[i], (userptr_t)temp_stack_ptr, str_pointer_size);
-    KASSERT(err == 0);
+    return result;
   }
-  // HARD PART: COPY ARGS TO USER STACK
 
-  as_destroy(as_old);
-  kfree(program_name_kernel);
-  // might want to free args_kernel
+  // a vforked child's old address space is its parent's
+  if (!vfork_release(curproc))
+  {
+    as_destroy(as_old);
+  }
 
   /* Warp to user mode. */
-  enter_new_process(num_args /*argc*/, (userptr_t)temp_stack_ptr /*userspace addr of argv*/,
-                    ROUNDUP(temp_stack_ptr, 8), entrypoint);
+  enter_new_process(ea.argc, argv, stackptr, entrypoint);
 
   /* enter_new_process does not return. */
   panic("enter_new_process returned\n");
   return EINVAL;
 }
+
+/* where a spawned child starts in user mode */
+struct spawn_start
+{
+  int argc;
+  userptr_t argv;
+  vaddr_t stackptr;
+  vaddr_t entrypoint;
+};
+
+static void spawn_enter(void *data, unsigned long unused)
+{
+  struct spawn_start *start = data;
+  (void)unused;
+
+  enter_new_process(start->argc, start->argv, start->stackptr, start->entrypoint);
+  panic("enter_new_process returned\n");
+}
+
+/*
+ * spawn: start a child running PROGRAM_NAME, as fork followed by execv
+ * in the child would, but without copying our address space. The
+ * program is loaded here, into an address space that is then given to
+ * the child, so load errors are reported to the caller.
+ */
+int sys_spawn(const char *program_name, char **args, pid_t *retval)
+{
+  struct exec_args ea;
+  struct addrspace *as;
+  struct spawn_start start;
+  struct proc *child;
+  int result;
+
+  result = copyin_program(program_name, args, &ea);
+  if (result)
+  {
+    return result;
+  }
+  start.argc = ea.argc;
+
+  // load it as if we were exec'ing, then take our own address space back
+  struct addrspace *as_old;
+  result = load_program(&ea, &as_old, &start.argv, &start.stackptr,
+                        &start.entrypoint);
+  kfree(ea.buf);
+  if (result)
+  {
+    return result;
+  }
+  as = curproc_setas(as_old);
+  as_activate();
+
+  result = fork_child(&child);
+  if (result)
+  {
+    as_destroy(as);
+    return result;
+  }
+  proc_setas(as, child);
+
+  pid_t pid = child->pid;
+  result = thread_fork_copy(child->p_name, child, spawn_enter, &start,
+                            sizeof(start), 0);
+  if (result)
+  {
+    proc_setas(NULL, child);
+    fork_undo(child);
+    as_destroy(as);
+    return result;
+  }
+
+  *retval = pid;
+  return (0);
+}
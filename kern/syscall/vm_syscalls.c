@@ -0,0 +1,186 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/mman.h>
+#include <kern/unistd.h>
+#include <lib.h>
+#include <syscall.h>
+#include <proc.h>
+#include <current.h>
+#include <vnode.h>
+#include <file.h>
+#include <addrspace.h>
+
+/*
+ * sbrk: move the end of the heap by AMOUNT bytes and return the old
+ * end. The heap starts out empty just past the program's data; the
+ * new pages are zero-filled when first touched.
+ */
+int
+sys_sbrk(intptr_t amount, vaddr_t *retval)
+{
+	struct addrspace *as;
+
+	as = curproc_getas();
+	if (as == NULL) {
+		return ENOMEM;
+	}
+	return as_sbrk(as, amount, retval);
+}
+
+/*
+ * Find the vnode open as descriptor FD, which must have been opened
+ * for reading, and for writing too if SHAREDWRITE. As for write,
+ * descriptors 0-2 are the console's.
+ */
+static
+int
+mmap_getfile(int fd, bool sharedwrite, struct vnode **ret)
+{
+	struct openfile *of;
+	int accmode, result;
+
+	if (fd == STDIN_FILENO || fd == STDOUT_FILENO ||
+	    fd == STDERR_FILENO) {
+		KASSERT(curproc->console != NULL);
+		*ret = curproc->console;
+		return 0;
+	}
+
+	result = file_get(fd, &of);
+	if (result) {
+		return result;
+	}
+	accmode = of->of_flags & O_ACCMODE;
+	if (accmode == O_WRONLY || (sharedwrite && accmode != O_RDWR)) {
+		return EACCES;
+	}
+	*ret = of->of_vnode;
+	return 0;
+}
+
+/*
+ * mmap: map LEN bytes, of the file open as FD from OFFSET, or of
+ * zero-filled memory with MAP_ANON. ADDR, if not 0, is where the
+ * caller would like the mapping; with MAP_FIXED it is where it must
+ * go. Anonymous mappings can only be private.
+ */
+int
+sys_mmap(vaddr_t addr, size_t len, int prot, int flags, int fd,
+	 off_t offset, vaddr_t *retval)
+{
+	struct addrspace *as;
+	struct vm_region *vr;
+	struct vnode *v;
+	off_t filesize, filesz;
+	size_t npages;
+	int share, perm, result;
+
+	share = flags & (MAP_SHARED | MAP_PRIVATE);
+	if ((share != MAP_SHARED && share != MAP_PRIVATE) ||
+	    (share == MAP_SHARED && (flags & MAP_ANON)) ||
+	    (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC)) != 0 ||
+	    (addr & PAGE_FRAME) != addr || len == 0) {
+		return EINVAL;
+	}
+	if (len > (size_t)-PAGE_SIZE) {
+		return ENOMEM;
+	}
+	npages = ROUNDUP(len, PAGE_SIZE) / PAGE_SIZE;
+
+	as = curproc_getas();
+	if (as == NULL) {
+		return ENOMEM;
+	}
+
+	v = NULL;
+	filesize = 0;
+	if ((flags & MAP_ANON) == 0) {
+		result = mmap_getfile(fd, share == MAP_SHARED &&
+				      (prot & PROT_WRITE) != 0, &v);
+		if (result) {
+			return result;
+		}
+		result = VOP_MMAP(v, offset, &filesize);
+		if (result) {
+			return result;
+		}
+	}
+
+	perm = 0;
+	if (prot & PROT_READ) {
+		perm |= VR_READ;
+	}
+	if (prot & PROT_WRITE) {
+		perm |= VR_WRITE;
+	}
+	if (prot & PROT_EXEC) {
+		perm |= VR_EXEC;
+	}
+	if (share == MAP_SHARED) {
+		perm |= VR_SHARED;
+	}
+
+	result = as_mmap(as, addr, npages, perm, (flags & MAP_FIXED) != 0,
+			 &vr);
+	if (result) {
+		return result;
+	}
+
+	if (v != NULL) {
+		/* Whole pages come from the file, up to its end. */
+		filesz = 0;
+		if (offset < filesize) {
+			filesz = filesize - offset;
+			if (filesz > (off_t)(npages * PAGE_SIZE)) {
+				filesz = npages * PAGE_SIZE;
+			}
+		}
+		result = as_define_filedata(as, v, offset, vr->vr_base,
+					    filesz);
+		if (result) {
+			as_munmap(as, vr->vr_base, npages * PAGE_SIZE);
+			return result;
+		}
+	}
+
+	*retval = vr->vr_base;
+	return 0;
+}
+
+/*
+ * munmap: remove the mappings in LEN bytes from ADDR, and free their
+ * pages.
+ */
+int
+sys_munmap(vaddr_t addr, size_t len)
+{
+	struct addrspace *as;
+
+	as = curproc_getas();
+	if (as == NULL) {
+		return EINVAL;
+	}
+	return as_munmap(as, addr, len);
+}
+
+/*
+ * msync: write back the dirty pages of shared file mappings in LEN
+ * bytes from ADDR. It is always done synchronously.
+ */
+int
+sys_msync(vaddr_t addr, size_t len, int flags)
+{
+	struct addrspace *as;
+
+	if ((flags & ~(MS_ASYNC | MS_SYNC | MS_INVALIDATE)) != 0 ||
+	    (flags & (MS_ASYNC | MS_SYNC)) == (MS_ASYNC | MS_SYNC)) {
+		return EINVAL;
+	}
+
+	as = curproc_getas();
+	if (as == NULL) {
+		return ENOMEM;
+	}
+	return as_msync(as, addr, len);
+}
@@ -0,0 +1,103 @@
+/*
+ * Coremap test code.
+ *
+ * Allocates every free frame, frees them all, and checks that the
+ * same number can be allocated again, so leaked frames show up.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <coremap.h>
+#include <test.h>
+
+#define NROUNDS    3
+#define BLOCKPAGES 8
+
+/*
+ * Allocate single frames until memory runs out, chaining them through
+ * their first word. Returns the number allocated.
+ */
+static
+unsigned
+cmt_fill(paddr_t *head)
+{
+	paddr_t pa;
+	unsigned count;
+
+	count = 0;
+	*head = 0;
+	while ((pa = coremap_alloc(1, true)) != 0) {
+		*(paddr_t *)PADDR_TO_KVADDR(pa) = *head;
+		*head = pa;
+		count++;
+	}
+	return count;
+}
+
+static
+void
+cmt_drain(paddr_t head)
+{
+	paddr_t next;
+
+	while (head != 0) {
+		next = *(paddr_t *)PADDR_TO_KVADDR(head);
+		coremap_free(head);
+		head = next;
+	}
+}
+
+int
+coremaptest(int nargs, char **args)
+{
+	paddr_t head, pa;
+	unsigned first, count;
+	int i;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting coremap test...\n");
+
+	first = 0;
+	for (i = 0; i < NROUNDS; i++) {
+		count = cmt_fill(&head);
+		kprintf("Round %d: allocated %u frames\n", i, count);
+		cmt_drain(head);
+		if (i == 0) {
+			first = count;
+		}
+		else if (count != first) {
+			panic("coremaptest: %u frames leaked\n", first - count);
+		}
+	}
+
+	/* Multi-page kernel blocks must be contiguous and reusable. */
+	for (i = 0; i < NROUNDS; i++) {
+		pa = coremap_alloc(BLOCKPAGES, true);
+		if (pa == 0) {
+			panic("coremaptest: no %d-page block free\n", BLOCKPAGES);
+		}
+		bzero((void *)PADDR_TO_KVADDR(pa), BLOCKPAGES * PAGE_SIZE);
+		coremap_free(pa);
+	}
+
+	/* Reference counts */
+	pa = coremap_alloc(1, false);
+	KASSERT(pa != 0);
+	KASSERT(coremap_refcount(pa) == 1);
+	coremap_incref(pa);
+	KASSERT(coremap_refcount(pa) == 2);
+	coremap_free(pa);
+	KASSERT(coremap_refcount(pa) == 1);
+	coremap_free(pa);
+
+	count = cmt_fill(&head);
+	cmt_drain(head);
+	if (count != first) {
+		panic("coremaptest: %u frames leaked\n", first - count);
+	}
+
+	kprintf("Coremap test done.\n");
+	return 0;
+}
@@ -243,6 +243,22 @@ vmstats_thread(void *junk, unsigned long num)
             }
             break;
 
+          case VMSTAT_ZERO_POOL_HIT:
+          case VMSTAT_ZERO_POOL_MISS:
+          case VMSTAT_TLB_FAULTAROUND:
+          case VMSTAT_ZCACHE_MISS:
+          case VMSTAT_ZCACHE_STORE:
+          case VMSTAT_ZCACHE_BYTES:
+            vmstats_inc(j);
+            break;
+
+          /* Part of the sums above, so left at zero */
+          case VMSTAT_ZCACHE_HIT:
+          case VMSTAT_TEXT_HIT:
+          case VMSTAT_PAGECACHE_HIT:
+          case VMSTAT_FILE_READ:
+            break;
+
           default:
             kprintf("Unknown stat %d\n", j);
             break;
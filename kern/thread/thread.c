@@ -52,6 +52,7 @@
 #include <vnode.h>
 
 #include "opt-synchprobs.h"
+#include "opt-vm.h"
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
@@ -72,6 +73,15 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/*
+ * Threads that have been destroyed, kept along with their stacks so
+ * that thread_fork can reuse them instead of allocating new ones.
+ */
+#define THREAD_CACHESIZE 16
+static struct spinlock thread_cache_lock = SPINLOCK_INITIALIZER;
+static struct thread *thread_cache[THREAD_CACHESIZE];
+static unsigned thread_cache_count;
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -112,34 +122,22 @@ thread_checkstack(struct thread *thread)
 }
 
 /*
- * Create a thread. This is used both to create a first thread
- * for each CPU and to create subsequent forked threads.
+ * Set up THREAD, which is new or was taken from the thread cache, to
+ * be a thread called NAME. Leaves t_stack alone.
  */
 static
-struct thread *
-thread_create(const char *name)
+void
+thread_init(struct thread *thread, const char *name)
 {
-	struct thread *thread;
-
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
-	if (thread == NULL) {
-		return NULL;
-	}
-
-	thread->t_name = kstrdup(name);
-	if (thread->t_name == NULL) {
-		kfree(thread);
-		return NULL;
-	}
+	snprintf(thread->t_name, sizeof(thread->t_name), "%s", name);
 	thread->t_wchan_name = "NEW";
 	thread->t_state = S_READY;
 
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
@@ -150,7 +148,49 @@ thread_create(const char *name)
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
 	/* If you add to struct thread, be sure to initialize here */
+}
+
+/*
+ * Create a thread. This is used both to create a first thread
+ * for each CPU and to create subsequent forked threads.
+ */
+static
+struct thread *
+thread_create(const char *name)
+{
+	struct thread *thread;
 
+	thread = kmalloc(sizeof(*thread));
+	if (thread == NULL) {
+		return NULL;
+	}
+	thread_init(thread, name);
+	thread->t_stack = NULL;
+
+	return thread;
+}
+
+/*
+ * Take a thread, with a stack, from the thread cache and set it up to
+ * be a thread called NAME. Returns NULL if the cache is empty.
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *thread;
+
+	spinlock_acquire(&thread_cache_lock);
+	thread = NULL;
+	if (thread_cache_count > 0) {
+		thread = thread_cache[--thread_cache_count];
+	}
+	spinlock_release(&thread_cache_lock);
+
+	if (thread != NULL) {
+		KASSERT(thread->t_stack != NULL);
+		thread_init(thread, name);
+	}
 	return thread;
 }
 
@@ -180,6 +220,12 @@ cpu_create(unsigned hardware_number)
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
+#if OPT_VM
+	c->c_tlbnext = 0;
+	c->c_asidgen = 1;
+	c->c_asidnext = 1;
+	c->c_tlbpid = 0;
+#endif
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
@@ -249,16 +295,25 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
-	if (thread->t_stack != NULL) {
-		kfree(thread->t_stack);
-	}
 	threadlistnode_cleanup(&thread->t_listnode);
 	thread_machdep_cleanup(&thread->t_machdep);
 
 	/* sheer paranoia */
 	thread->t_wchan_name = "DESTROYED";
 
-	kfree(thread->t_name);
+	if (thread->t_stack != NULL) {
+		/* Keep it, stack and all, for thread_fork to reuse. */
+		spinlock_acquire(&thread_cache_lock);
+		if (thread_cache_count < THREAD_CACHESIZE) {
+			thread_cache[thread_cache_count++] = thread;
+			thread = NULL;
+		}
+		spinlock_release(&thread_cache_lock);
+		if (thread == NULL) {
+			return;
+		}
+		kfree(thread->t_stack);
+	}
 	kfree(thread);
 }
 
@@ -465,38 +520,42 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 }
 
 /*
- * Create a new thread based on an existing one.
- *
- * The new thread has name NAME, and starts executing in function
- * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
- *
- * The new thread is created in the process P. If P is null, the
- * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * Create a new thread based on an existing one. See thread_fork and
+ * thread_fork_copy; if COPY is not NULL, the new thread gets a copy of
+ * the COPYLEN bytes it points to as DATA1.
  */
+static
 int
-thread_fork(const char *name,
-	    struct proc *proc,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2)
+thread_fork_common(const char *name,
+		   struct proc *proc,
+		   void (*entrypoint)(void *data1, unsigned long data2),
+		   void *data1, const void *copy, size_t copylen,
+		   unsigned long data2)
 {
 	struct thread *newthread;
+	size_t reserve;
 	int result;
 
 #ifdef UW
 	DEBUG(DB_THREADS,"Forking thread: %s\n",name);
 #endif // UW
 
-	newthread = thread_create(name);
+	reserve = ROUNDUP(copylen, 8);
+	KASSERT(reserve <= STACK_SIZE / 4);
+
+	newthread = thread_cache_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
 	}
 	thread_checkstack_init(newthread);
 
@@ -525,8 +584,14 @@ thread_fork(const char *name,
 	 */
 	newthread->t_iplhigh_count++;
 
+	/* The copy goes at the top of the stack, above the switchframe. */
+	if (copy != NULL) {
+		data1 = (char *)newthread->t_stack + STACK_SIZE - reserve;
+		memcpy(data1, copy, copylen);
+	}
+
 	/* Set up the switchframe so entrypoint() gets called */
-	switchframe_init(newthread, entrypoint, data1, data2);
+	switchframe_init(newthread, entrypoint, data1, data2, reserve);
 
 	/* Lock the current cpu's run queue and make the new thread runnable */
 	thread_make_runnable(newthread, false);
@@ -534,6 +599,42 @@ thread_fork(const char *name,
 	return 0;
 }
 
+/*
+ * Create a new thread based on an existing one.
+ *
+ * The new thread has name NAME, and starts executing in function
+ * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
+ *
+ * The new thread is created in the process P. If P is null, the
+ * process is inherited from the caller. It will start on the same CPU
+ * as the caller, unless the scheduler intervenes first.
+ */
+int
+thread_fork(const char *name,
+	    struct proc *proc,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2)
+{
+	return thread_fork_common(name, proc, entrypoint, data1, NULL, 0,
+				  data2);
+}
+
+/*
+ * Like thread_fork, but ENTRYPOINT is passed a copy of the LEN bytes
+ * at DATA1, kept on the new thread's own stack, so the caller doesn't
+ * have to keep them around or allocate memory for them.
+ */
+int
+thread_fork_copy(const char *name,
+		 struct proc *proc,
+		 void (*entrypoint)(void *data1, unsigned long data2),
+		 const void *data1, size_t len, unsigned long data2)
+{
+	KASSERT(data1 != NULL);
+	return thread_fork_common(name, proc, entrypoint, NULL, data1, len,
+				  data2);
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -635,7 +736,14 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
+#if OPT_VM
+			/* Use the time for VM housekeeping if there is any. */
+			if (!vm_idle()) {
+				cpu_idle();
+			}
+#else
 			cpu_idle();
+#endif
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
@@ -1140,28 +1248,71 @@ ipi_broadcast(int code)
 	}
 }
 
+/*
+ * Add MAPPING to TARGET's shootdown queue. Call with the IPI lock
+ * held.
+ */
+static
 void
-ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
+ipi_tlbshootdown_queue(struct cpu *target, const struct tlbshootdown *mapping)
 {
 	int n;
 
-	spinlock_acquire(&target->c_ipi_lock);
-
 	n = target->c_numshootdown;
-	if (n == TLBSHOOTDOWN_MAX) {
+	if (n == TLBSHOOTDOWN_ALL) {
+		/* already flushing everything */
+	}
+	else if (n == TLBSHOOTDOWN_MAX) {
 		target->c_numshootdown = TLBSHOOTDOWN_ALL;
 	}
 	else {
 		target->c_shootdown[n] = *mapping;
 		target->c_numshootdown = n+1;
 	}
+}
+
+void
+ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
+{
+	spinlock_acquire(&target->c_ipi_lock);
 
+	ipi_tlbshootdown_queue(target, mapping);
 	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
 	mainbus_send_ipi(target);
 
 	spinlock_release(&target->c_ipi_lock);
 }
 
+#if OPT_VM
+unsigned
+ipi_tlbshootdown_cpus(uint32_t cpumask, const struct tlbshootdown *mappings,
+		      unsigned n)
+{
+	unsigned i, j, count;
+	struct cpu *c;
+
+	count = 0;
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == curcpu->c_self ||
+		    (cpumask & ((uint32_t)1 << c->c_number)) == 0) {
+			continue;
+		}
+
+		spinlock_acquire(&c->c_ipi_lock);
+		for (j=0; j<n; j++) {
+			ipi_tlbshootdown_queue(c, &mappings[j]);
+		}
+		c->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
+		mainbus_send_ipi(c);
+		spinlock_release(&c->c_ipi_lock);
+
+		count++;
+	}
+	return count;
+}
+#endif /* OPT_VM */
+
 void
 interprocessor_interrupt(void)
 {
@@ -241,15 +241,19 @@ null_fsync(struct vnode *v)
 }
 
 /*
- * For mmap. If you want this to do anything, you have to write it
- * yourself. Some devices may not make sense to map. Others do.
+ * For mmap. Pages of a mapping are read and written through the
+ * vnode like a file's, which makes sense for disks but not for the
+ * console and the like; since there is no way to tell them apart here,
+ * no device can be mapped.
  */
 static
 int
-dev_mmap(struct vnode *v  /* add stuff as needed */)
+dev_mmap(struct vnode *v, off_t offset, off_t *size)
 {
 	(void)v;
-	return EUNIMP;
+	(void)offset;
+	(void)size;
+	return ENODEV;
 }
 
 /*
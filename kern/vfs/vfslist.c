@@ -43,6 +43,10 @@
 #include <fs.h>
 #include <vnode.h>
 #include <device.h>
+#include "opt-vm.h"
+#if OPT_VM
+#include <execcache.h>
+#endif
 
 /*
  * Structure for a single named device.
@@ -557,6 +561,11 @@ vfs_unmount(const char *devname)
 	struct knowndev *kd;
 	int result;
 
+#if OPT_VM
+	/* The exec image cache holds on to executables' vnodes. */
+	execcache_purge();
+#endif
+
 	vfs_biglock_acquire();
 
 	result = findmount(devname, &kd);
@@ -603,6 +612,11 @@ vfs_unmountall(void)
 	unsigned i, num;
 	int result;
 
+#if OPT_VM
+	/* The exec image cache holds on to executables' vnodes. */
+	execcache_purge();
+#endif
+
 	vfs_biglock_acquire();
 
 	num = knowndevarray_num(knowndevs);
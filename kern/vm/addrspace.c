@@ -0,0 +1,721 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <array.h>
+#include <clock.h>
+#include <proc.h>
+#include <vnode.h>
+#include <addrspace.h>
+#include <pagetable.h>
+#include <coremap.h>
+#include <vm.h>
+
+/*
+ * Address spaces for the paged VM system.
+ *
+ * An address space is a list of regions plus a page table. Regions
+ * may be defined in any number and order; the page table records
+ * which physical page, if any, backs each virtual page.
+ *
+ * Program segments are not read in at exec time. Each region that
+ * holds one keeps a reference to the executable, and vm_fault reads
+ * (or zero-fills) a page the first time it is touched.
+ */
+
+struct addrspace *
+as_create(void)
+{
+	struct addrspace *as;
+
+	as = kmalloc(sizeof(struct addrspace));
+	if (as == NULL) {
+		return NULL;
+	}
+
+	as->as_regions = array_create();
+	if (as->as_regions == NULL) {
+		kfree(as);
+		return NULL;
+	}
+
+	as->as_pt = pt_create();
+	if (as->as_pt == NULL) {
+		array_destroy(as->as_regions);
+		kfree(as);
+		return NULL;
+	}
+
+	bzero(as->as_asid, sizeof(as->as_asid));
+	as->as_heap = NULL;
+	as->as_heapbrk = 0;
+
+	spinlock_init(&as->as_statlock);
+	as->as_rss = 0;
+	as->as_faults = 0;
+	as->as_lastfaults = 0;
+	gettime(&as->as_lastsec, &as->as_lastnsec);
+
+	return as;
+}
+
+/*
+ * Free every page of region VR, resident or swapped out.
+ */
+static
+void
+as_free_region_pages(struct addrspace *as, struct vm_region *vr)
+{
+	vaddr_t va;
+	pte_t *pte;
+	size_t i;
+
+	for (i = 0; i < vr->vr_npages; i++) {
+		va = vr->vr_base + i * PAGE_SIZE;
+		pte = pt_lookup(as->as_pt, va, false);
+		if (pte != NULL && *pte != 0) {
+			vm_page_discard(as, vr, va, pte);
+		}
+	}
+}
+
+void
+as_destroy(struct addrspace *as)
+{
+	struct vm_region *vr;
+	unsigned i;
+
+	for (i = array_num(as->as_regions); i > 0; i--) {
+		vr = array_get(as->as_regions, i - 1);
+		as_free_region_pages(as, vr);
+		if (vr->vr_vnode != NULL) {
+			VOP_DECREF(vr->vr_vnode);
+		}
+		kfree(vr);
+		array_remove(as->as_regions, i - 1);
+	}
+	array_destroy(as->as_regions);
+	pt_destroy(as->as_pt);
+	KASSERT(as->as_rss == 0);
+	spinlock_cleanup(&as->as_statlock);
+	kfree(as);
+}
+
+struct vm_region *
+as_find_region(struct addrspace *as, vaddr_t vaddr)
+{
+	struct vm_region *vr;
+	unsigned i;
+
+	for (i = 0; i < array_num(as->as_regions); i++) {
+		vr = array_get(as->as_regions, i);
+		if (vaddr >= vr->vr_base &&
+		    vaddr < vr->vr_base + vr->vr_npages * PAGE_SIZE) {
+			return vr;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Add a region of NPAGES pages at page-aligned address VADDR. Fails
+ * if it overlaps an existing region or runs into kernel space. Only
+ * the heap may be empty.
+ */
+static
+int
+as_add_region(struct addrspace *as, vaddr_t vaddr, size_t npages, int perm,
+	      struct vm_region **ret)
+{
+	struct vm_region *vr;
+	vaddr_t top;
+	unsigned i;
+	int result;
+
+	KASSERT((vaddr & PAGE_FRAME) == vaddr);
+
+	top = vaddr + npages * PAGE_SIZE;
+	if ((npages == 0 && (perm & VR_HEAP) == 0) ||
+	    top > USERSPACETOP || top < vaddr) {
+		return EFAULT;
+	}
+
+	for (i = 0; i < array_num(as->as_regions); i++) {
+		vr = array_get(as->as_regions, i);
+		if (vaddr < vr->vr_base + vr->vr_npages * PAGE_SIZE &&
+		    vr->vr_base < top) {
+			return EFAULT;
+		}
+	}
+
+	vr = kmalloc(sizeof(struct vm_region));
+	if (vr == NULL) {
+		return ENOMEM;
+	}
+	vr->vr_base = vaddr;
+	vr->vr_npages = npages;
+	vr->vr_perm = perm;
+	vr->vr_vnode = NULL;
+	vr->vr_fileoff = 0;
+	vr->vr_filevaddr = vaddr;
+	vr->vr_filesz = 0;
+	vr->vr_around = VM_FAULTAROUND;
+	vr->vr_window = VM_FAULTAROUND_MIN;
+	vr->vr_lastfault = vaddr;
+
+	result = array_add(as->as_regions, vr, NULL);
+	if (result) {
+		kfree(vr);
+		return result;
+	}
+	if (ret != NULL) {
+		*ret = vr;
+	}
+	return 0;
+}
+
+int
+as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
+		 int readable, int writeable, int executable)
+{
+	int perm;
+
+	/* Align the region. First, the base... */
+	sz += vaddr & ~(vaddr_t)PAGE_FRAME;
+	vaddr &= PAGE_FRAME;
+
+	/* ...and now the length. */
+	sz = (sz + PAGE_SIZE - 1) & PAGE_FRAME;
+
+	perm = 0;
+	if (readable) {
+		perm |= VR_READ;
+	}
+	if (writeable) {
+		perm |= VR_WRITE;
+	}
+	if (executable) {
+		perm |= VR_EXEC;
+	}
+
+	return as_add_region(as, vaddr, sz / PAGE_SIZE, perm, NULL);
+}
+
+int
+as_define_filedata(struct addrspace *as, struct vnode *v, off_t offset,
+		   vaddr_t vaddr, size_t filesize)
+{
+	struct vm_region *vr;
+
+	vr = as_find_region(as, vaddr);
+	if (vr == NULL || vr->vr_vnode != NULL) {
+		return EFAULT;
+	}
+	if (filesize > vr->vr_base + vr->vr_npages * PAGE_SIZE - vaddr) {
+		return EFAULT;
+	}
+
+	VOP_INCREF(v);
+	vr->vr_vnode = v;
+	vr->vr_fileoff = offset;
+	vr->vr_filevaddr = vaddr;
+	vr->vr_filesz = filesize;
+	return 0;
+}
+
+int
+as_prepare_load(struct addrspace *as)
+{
+	/* Nothing to do: pages are filled in on demand. */
+	(void)as;
+	return 0;
+}
+
+/*
+ * Set up an empty heap just past the highest segment.
+ */
+int
+as_complete_load(struct addrspace *as)
+{
+	struct vm_region *vr;
+	vaddr_t top, base;
+	unsigned i;
+	int result;
+
+	base = 0;
+	for (i = 0; i < array_num(as->as_regions); i++) {
+		vr = array_get(as->as_regions, i);
+		top = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+		if (top > base) {
+			base = top;
+		}
+	}
+
+	result = as_add_region(as, base, 0, VR_READ | VR_WRITE | VR_HEAP,
+			       &as->as_heap);
+	if (result) {
+		return result;
+	}
+	as->as_heapbrk = base;
+	return 0;
+}
+
+int
+as_define_stack(struct addrspace *as, vaddr_t *stackptr)
+{
+	int result;
+
+	/* Pages are filled in, and the stack grown, on demand. */
+	result = as_add_region(as, USERSTACK - VM_STACKPAGES * PAGE_SIZE,
+			       VM_STACKPAGES, VR_READ | VR_WRITE | VR_STACK,
+			       NULL);
+	if (result) {
+		return result;
+	}
+
+	*stackptr = USERSTACK;
+	return 0;
+}
+
+/*
+ * Free the pages of region VR from LO up to HI, and take them out of
+ * this CPU's TLB. The caller must see to other CPUs (vm_tlb_forget).
+ */
+static
+void
+as_discard_range(struct addrspace *as, struct vm_region *vr, vaddr_t lo,
+		 vaddr_t hi)
+{
+	vaddr_t va;
+	pte_t *pte;
+
+	for (va = lo; va < hi; va += PAGE_SIZE) {
+		pte = pt_lookup(as->as_pt, va, false);
+		if (pte != NULL && *pte != 0) {
+			vm_page_discard(as, vr, va, pte);
+			vm_tlb_invalidate(as, va);
+		}
+	}
+}
+
+int
+as_sbrk(struct addrspace *as, intptr_t amount, vaddr_t *oldbrk)
+{
+	struct vm_region *heap, *vr;
+	vaddr_t brk, top, newtop;
+	unsigned i;
+
+	heap = as->as_heap;
+	if (heap == NULL) {
+		return ENOMEM;
+	}
+
+	brk = as->as_heapbrk;
+	if (amount < 0 && (vaddr_t)-amount > brk - heap->vr_base) {
+		return EINVAL;
+	}
+	if (amount > 0 && (brk + amount < brk ||
+			   brk + amount > USERSPACETOP)) {
+		return ENOMEM;
+	}
+
+	top = heap->vr_base + heap->vr_npages * PAGE_SIZE;
+	newtop = ROUNDUP(brk + amount, PAGE_SIZE);
+
+	if (newtop > top) {
+		/* Don't run into anything, or up to the stack. */
+		for (i = 0; i < array_num(as->as_regions); i++) {
+			vr = array_get(as->as_regions, i);
+			if (vr == heap || vr->vr_base < top) {
+				continue;
+			}
+			if (newtop > vr->vr_base ||
+			    ((vr->vr_perm & VR_STACK) &&
+			     newtop + VM_STACKGUARD * PAGE_SIZE > vr->vr_base)) {
+				return ENOMEM;
+			}
+		}
+	}
+	else if (newtop < top) {
+		as_discard_range(as, heap, newtop, top);
+		/* Other CPUs may still have the old pages. */
+		vm_tlb_forget(as);
+	}
+
+	heap->vr_npages = (newtop - heap->vr_base) / PAGE_SIZE;
+	as->as_heapbrk = brk + amount;
+	*oldbrk = brk;
+	return 0;
+}
+
+/*
+ * Lowest address the stack can grow down to, less its guard gap.
+ * Mappings are kept below it.
+ */
+#define AS_STACKFLOOR \
+	(USERSTACK - (VM_STACKMAXPAGES + VM_STACKGUARD) * PAGE_SIZE)
+
+/*
+ * Return true if no region overlaps BASE up to TOP. Otherwise return
+ * false, with the lowest base of the regions in the way in *CLASH.
+ */
+static
+bool
+as_range_free(struct addrspace *as, vaddr_t base, vaddr_t top,
+	      vaddr_t *clash)
+{
+	struct vm_region *vr;
+	unsigned i;
+	bool isfree;
+
+	isfree = true;
+	for (i = 0; i < array_num(as->as_regions); i++) {
+		vr = array_get(as->as_regions, i);
+		if (base < vr->vr_base + vr->vr_npages * PAGE_SIZE &&
+		    vr->vr_base < top) {
+			if (isfree || vr->vr_base < *clash) {
+				*clash = vr->vr_base;
+			}
+			isfree = false;
+		}
+	}
+	return isfree;
+}
+
+int
+as_mmap(struct addrspace *as, vaddr_t addr, size_t npages, int perm,
+	bool fixed, struct vm_region **ret)
+{
+	vaddr_t floor, limit, size, base, clash;
+
+	KASSERT((addr & PAGE_FRAME) == addr);
+
+	floor = 0;
+	if (as->as_heap != NULL) {
+		floor = as->as_heap->vr_base +
+			as->as_heap->vr_npages * PAGE_SIZE;
+	}
+	limit = AS_STACKFLOOR;
+
+	size = npages * PAGE_SIZE;
+	if (npages == 0 || size / PAGE_SIZE != npages) {
+		return EINVAL;
+	}
+
+	base = 0;
+	if (addr != 0 && addr >= floor && addr <= limit &&
+	    size <= limit - addr &&
+	    as_range_free(as, addr, addr + size, &clash)) {
+		base = addr;
+	}
+	else if (fixed) {
+		return EINVAL;
+	}
+
+	/* Take the highest gap that is big enough. */
+	while (base == 0) {
+		if (limit < floor || limit - floor < size) {
+			return ENOMEM;
+		}
+		if (as_range_free(as, limit - size, limit, &clash)) {
+			base = limit - size;
+		}
+		else {
+			limit = clash;
+		}
+	}
+
+	return as_add_region(as, base, npages, perm | VR_MMAP, ret);
+}
+
+int
+as_munmap(struct addrspace *as, vaddr_t addr, size_t len)
+{
+	struct vm_region *vr, *split;
+	vaddr_t top, vrtop, lo, hi;
+	unsigned i;
+	int result;
+
+	if ((addr & PAGE_FRAME) != addr || len == 0) {
+		return EINVAL;
+	}
+	top = ROUNDUP(addr + len, PAGE_SIZE);
+	if (top <= addr || top > USERSPACETOP) {
+		return EINVAL;
+	}
+
+	/*
+	 * Check that it is all mappings before touching anything. At
+	 * most one region can be split in two; make its upper part now,
+	 * so that running out of memory leaves everything as it was.
+	 */
+	split = NULL;
+	for (i = 0; i < array_num(as->as_regions); i++) {
+		vr = array_get(as->as_regions, i);
+		vrtop = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+		if (addr >= vrtop || vr->vr_base >= top) {
+			continue;
+		}
+		if ((vr->vr_perm & VR_MMAP) == 0) {
+			return EINVAL;
+		}
+		if (vr->vr_base < addr && top < vrtop) {
+			split = vr;
+		}
+	}
+	if (split != NULL) {
+		vr = kmalloc(sizeof(struct vm_region));
+		if (vr == NULL) {
+			return ENOMEM;
+		}
+		*vr = *split;
+		vr->vr_base = top;
+		vr->vr_npages -= (top - split->vr_base) / PAGE_SIZE;
+		vr->vr_lastfault = top;
+		result = array_add(as->as_regions, vr, NULL);
+		if (result) {
+			kfree(vr);
+			return result;
+		}
+		if (vr->vr_vnode != NULL) {
+			VOP_INCREF(vr->vr_vnode);
+		}
+	}
+
+	for (i = array_num(as->as_regions); i > 0; i--) {
+		vr = array_get(as->as_regions, i - 1);
+		vrtop = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+		if (addr >= vrtop || vr->vr_base >= top) {
+			continue;
+		}
+		lo = addr > vr->vr_base ? addr : vr->vr_base;
+		hi = top < vrtop ? top : vrtop;
+		as_discard_range(as, vr, lo, hi);
+
+		if (lo == vr->vr_base && hi == vrtop) {
+			if (vr->vr_vnode != NULL) {
+				VOP_DECREF(vr->vr_vnode);
+			}
+			kfree(vr);
+			array_remove(as->as_regions, i - 1);
+		}
+		else if (lo == vr->vr_base) {
+			vr->vr_base = hi;
+			vr->vr_npages = (vrtop - hi) / PAGE_SIZE;
+			vr->vr_lastfault = hi;
+		}
+		else {
+			vr->vr_npages = (lo - vr->vr_base) / PAGE_SIZE;
+			vr->vr_lastfault = vr->vr_base;
+		}
+	}
+
+	/* Other CPUs may still have the old pages. */
+	vm_tlb_forget(as);
+	return 0;
+}
+
+int
+as_msync(struct addrspace *as, vaddr_t addr, size_t len)
+{
+	struct vm_region *vr;
+	vaddr_t top, vrtop, hi, va, pva;
+	pte_t *pte;
+	int result;
+
+	if ((addr & PAGE_FRAME) != addr) {
+		return EINVAL;
+	}
+	top = ROUNDUP(addr + len, PAGE_SIZE);
+	if (top < addr || top > USERSPACETOP) {
+		return ENOMEM;
+	}
+
+	for (va = addr; va < top; va = vrtop) {
+		vr = as_find_region(as, va);
+		if (vr == NULL || (vr->vr_perm & VR_MMAP) == 0) {
+			return ENOMEM;
+		}
+		vrtop = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+		if ((vr->vr_perm & VR_SHARED) == 0 || vr->vr_vnode == NULL) {
+			continue;
+		}
+
+		hi = top < vrtop ? top : vrtop;
+		for (pva = va; pva < hi; pva += PAGE_SIZE) {
+			pte = pt_lookup(as->as_pt, pva, false);
+			if (pte == NULL) {
+				continue;
+			}
+			result = vm_page_sync(vr, pva, pte);
+			if (result) {
+				return result;
+			}
+		}
+		result = VOP_FSYNC(vr->vr_vnode);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+void
+as_addrss(struct addrspace *as, int delta)
+{
+	spinlock_acquire(&as->as_statlock);
+	KASSERT(delta >= 0 || as->as_rss >= (unsigned)-delta);
+	as->as_rss += delta;
+	spinlock_release(&as->as_statlock);
+}
+
+void
+as_addfault(struct addrspace *as)
+{
+	spinlock_acquire(&as->as_statlock);
+	as->as_faults++;
+	spinlock_release(&as->as_statlock);
+}
+
+void
+as_getstats(struct addrspace *as, unsigned *rss, unsigned *faults,
+	    unsigned *rate)
+{
+	time_t sec;
+	uint32_t nsec;
+	int64_t ms;
+
+	gettime(&sec, &nsec);
+
+	spinlock_acquire(&as->as_statlock);
+	ms = (sec - as->as_lastsec) * 1000 +
+		((int32_t)nsec - (int32_t)as->as_lastnsec) / 1000000;
+	*rss = as->as_rss;
+	*faults = as->as_faults;
+	*rate = ms <= 0 ? 0 :
+		(as->as_faults - as->as_lastfaults) * (uint64_t)1000 / ms;
+	as->as_lastfaults = as->as_faults;
+	as->as_lastsec = sec;
+	as->as_lastnsec = nsec;
+	spinlock_release(&as->as_statlock);
+}
+
+struct vm_region *
+as_grow_stack(struct addrspace *as, vaddr_t vaddr)
+{
+	struct vm_region *stack, *vr;
+	vaddr_t guard;
+	unsigned i;
+
+	vaddr &= PAGE_FRAME;
+
+	stack = NULL;
+	for (i = 0; i < array_num(as->as_regions); i++) {
+		vr = array_get(as->as_regions, i);
+		if (vr->vr_perm & VR_STACK) {
+			stack = vr;
+			break;
+		}
+	}
+	if (stack == NULL || vaddr >= stack->vr_base ||
+	    vaddr < USERSTACK - VM_STACKMAXPAGES * PAGE_SIZE) {
+		return NULL;
+	}
+
+	/* Leave a gap, so running off the end faults. */
+	guard = vaddr > VM_STACKGUARD * PAGE_SIZE ?
+		vaddr - VM_STACKGUARD * PAGE_SIZE : 0;
+	for (i = 0; i < array_num(as->as_regions); i++) {
+		vr = array_get(as->as_regions, i);
+		if (vr != stack && vr->vr_base < stack->vr_base &&
+		    vr->vr_base + vr->vr_npages * PAGE_SIZE > guard) {
+			return NULL;
+		}
+	}
+
+	stack->vr_npages += (stack->vr_base - vaddr) / PAGE_SIZE;
+	stack->vr_base = vaddr;
+	return stack;
+}
+
+/*
+ * Copy an address space. Resident pages are not copied; instead both
+ * address spaces map the same frame read-only and take a reference to
+ * it. The first write to such a page (a VM_FAULT_READONLY in a
+ * writeable region) gives the writer its own copy; see vm_fault.
+ * Pages that are out in swap are brought back in to be shared.
+ */
+int
+as_copy(struct addrspace *old, struct addrspace **ret)
+{
+	struct addrspace *new;
+	struct vm_region *oldvr, *newvr;
+	pte_t *oldpte, *newpte;
+	paddr_t pa;
+	vaddr_t va;
+	unsigned i;
+	size_t j;
+	int result;
+
+	new = as_create();
+	if (new == NULL) {
+		return ENOMEM;
+	}
+
+	for (i = 0; i < array_num(old->as_regions); i++) {
+		oldvr = array_get(old->as_regions, i);
+		result = as_add_region(new, oldvr->vr_base, oldvr->vr_npages,
+				       oldvr->vr_perm, &newvr);
+		if (result) {
+			as_destroy(new);
+			return result;
+		}
+		newvr->vr_around = oldvr->vr_around;
+		if (oldvr == old->as_heap) {
+			new->as_heap = newvr;
+			new->as_heapbrk = old->as_heapbrk;
+		}
+		if (oldvr->vr_vnode != NULL) {
+			VOP_INCREF(oldvr->vr_vnode);
+			newvr->vr_vnode = oldvr->vr_vnode;
+			newvr->vr_fileoff = oldvr->vr_fileoff;
+			newvr->vr_filevaddr = oldvr->vr_filevaddr;
+			newvr->vr_filesz = oldvr->vr_filesz;
+		}
+
+		for (j = 0; j < oldvr->vr_npages; j++) {
+			va = oldvr->vr_base + j * PAGE_SIZE;
+			oldpte = pt_lookup(old->as_pt, va, false);
+			if (oldpte == NULL || *oldpte == 0) {
+				continue;
+			}
+			newpte = pt_lookup(new->as_pt, va, true);
+			if (newpte == NULL) {
+				as_destroy(new);
+				return ENOMEM;
+			}
+			result = vm_page_get(old, oldvr, va, oldpte);
+			if (result) {
+				as_destroy(new);
+				return result;
+			}
+			pa = *oldpte & PTE_FRAME;
+			coremap_incref(pa);
+			*oldpte &= ~PTE_WRITE;
+			*newpte = *oldpte;
+			as_addrss(new, 1);
+			coremap_unpin(pa);
+		}
+	}
+
+	/*
+	 * The parent may still have writeable translations for the
+	 * pages we just shared, here and on CPUs it ran on before.
+	 */
+	vm_tlb_forget(old);
+	if (old == curproc_getas()) {
+		vm_tlb_flush();
+	}
+
+	*ret = new;
+	return 0;
+}
@@ -0,0 +1,802 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <cpu.h>
+#include <current.h>
+#include <platform/maxcpus.h>
+#include <addrspace.h>
+#include <pagetable.h>
+#include <coremap.h>
+#include <swap.h>
+
+/*
+ * Physical frame allocator. See coremap.h.
+ */
+
+/* "No frame" value for the free list links */
+#define CM_NONE  0xffffffff
+
+/* Frame states */
+#define CME_FREE    0
+#define CME_KERNEL  1
+#define CME_USER    2
+#define CME_ZEROING 3	/* off the free lists, being zeroed */
+#define CME_CACHED  4	/* free, in a CPU's frame cache */
+
+/* Frame flags */
+#define CMF_BUSY    0x01	/* pinned; see coremap_pin */
+#define CMF_TEXT    0x02	/* in the shared text cache */
+#define CMF_ZERO    0x04	/* free, on the zeroed list */
+#define CMF_FILE    0x08	/* in the mapped file page cache */
+
+/* How many zeroed free frames the idle loop keeps ready */
+#define CM_ZEROPOOL 32
+
+/* Per-CPU frame caches: capacity, and frames moved at a time */
+#define CM_PCPU_MAX    16
+#define CM_PCPU_BATCH  8
+
+struct coremap_entry {
+	uint32_t cme_next;		/* free list links (frame numbers) */
+	uint32_t cme_prev;
+	uint32_t cme_npages;		/* block length, on a block's first frame */
+	uint16_t cme_refcount;		/* references to the block */
+	uint8_t cme_state;		/* CME_FREE, CME_KERNEL or CME_USER */
+	uint8_t cme_flags;		/* CMF_* */
+	struct addrspace *cme_as;	/* owner of an evictable user page */
+	vaddr_t cme_vaddr;		/* ...and where it is mapped */
+	uint32_t cme_swapslot;		/* clean copy in swap, or SWAP_NOSLOT */
+};
+
+/*
+ * coremap_lock protects everything below. Before coremap_bootstrap
+ * runs it also serializes calls to ram_stealmem.
+ */
+static struct spinlock coremap_lock = SPINLOCK_INITIALIZER;
+
+static struct coremap_entry *coremap;	/* NULL until bootstrapped */
+static paddr_t cm_base;			/* physical address of frame 0 */
+static uint32_t cm_nframes;		/* number of frames managed */
+static uint32_t cm_nfree;		/* number of frames on the free lists */
+static uint32_t cm_freehead;		/* first free frame */
+static uint32_t cm_zerohead;		/* first free frame known to be zero */
+static uint32_t cm_nzero;		/* number of frames on that list */
+static uint32_t cm_hand;		/* the replacement clock's hand */
+
+/* Threads waiting for a frame to be unpinned */
+static struct wchan *cm_wchan;
+
+/*
+ * Each CPU keeps a few free frames of its own, so that most single
+ * page allocations and frees don't touch coremap_lock. The caches are
+ * refilled from and drained to the free list CM_PCPU_BATCH frames at a
+ * time. Each has a lock, but only its own CPU takes it, except when
+ * the free list runs dry and coremap_alloc collects every cached
+ * frame (cm_pcpu_reclaim). Lock order: cp_lock, then coremap_lock.
+ *
+ * A single kernel page can be freed into a cache without the lock,
+ * since nobody else can be looking at it. A user page always goes
+ * through the lock, which clears CMF_BUSY and wakes anyone waiting in
+ * coremap_pin before the frame leaves the coremap's hands. Cached
+ * frames keep CMF_BUSY set, so that the victim search never mistakes
+ * one on its way in for a user page.
+ */
+struct cm_pcpu {
+	struct spinlock cp_lock;
+	uint32_t cp_frames[CM_PCPU_MAX];
+	unsigned cp_n;
+};
+static struct cm_pcpu cm_pcpu[MAXCPUS];
+
+#define CM_PADDR(f)  (cm_base + (paddr_t)(f) * PAGE_SIZE)
+#define CM_FRAME(pa) (((pa) - cm_base) / PAGE_SIZE)
+
+/* Take frame F off whichever free list it is on. */
+static
+void
+cm_unlink(uint32_t f)
+{
+	struct coremap_entry *e = &coremap[f];
+	uint32_t *head;
+
+	if (e->cme_flags & CMF_ZERO) {
+		head = &cm_zerohead;
+		cm_nzero--;
+	}
+	else {
+		head = &cm_freehead;
+	}
+
+	if (e->cme_prev == CM_NONE) {
+		KASSERT(*head == f);
+		*head = e->cme_next;
+	}
+	else {
+		coremap[e->cme_prev].cme_next = e->cme_next;
+	}
+	if (e->cme_next != CM_NONE) {
+		coremap[e->cme_next].cme_prev = e->cme_prev;
+	}
+	e->cme_next = e->cme_prev = CM_NONE;
+	e->cme_flags = 0;
+}
+
+/*
+ * Put frame F at the head of the free list, or of the zeroed list if
+ * ZEROED is set.
+ */
+static
+void
+cm_push(uint32_t f, bool zeroed)
+{
+	struct coremap_entry *e = &coremap[f];
+	uint32_t *head;
+
+	head = zeroed ? &cm_zerohead : &cm_freehead;
+
+	e->cme_state = CME_FREE;
+	e->cme_refcount = 0;
+	e->cme_npages = 0;
+	e->cme_flags = zeroed ? CMF_ZERO : 0;
+	e->cme_as = NULL;
+	e->cme_vaddr = 0;
+	e->cme_swapslot = SWAP_NOSLOT;
+	e->cme_prev = CM_NONE;
+	e->cme_next = *head;
+	if (*head != CM_NONE) {
+		coremap[*head].cme_prev = f;
+	}
+	*head = f;
+	if (zeroed) {
+		cm_nzero++;
+	}
+}
+
+void
+coremap_bootstrap(void)
+{
+	paddr_t lo, hi;
+	size_t cmsize;
+	uint32_t npages, f;
+
+	ram_getsize(&lo, &hi);
+	KASSERT((lo & PAGE_FRAME) == lo);
+	KASSERT((hi & PAGE_FRAME) == hi);
+
+	/* The coremap itself lives at the bottom of the free memory. */
+	npages = (hi - lo) / PAGE_SIZE;
+	cmsize = ROUNDUP(npages * sizeof(struct coremap_entry), PAGE_SIZE);
+	KASSERT(lo + cmsize < hi);
+
+	spinlock_acquire(&coremap_lock);
+
+	cm_base = lo + cmsize;
+	cm_nframes = (hi - cm_base) / PAGE_SIZE;
+	cm_nfree = cm_nframes;
+	cm_freehead = CM_NONE;
+	cm_zerohead = CM_NONE;
+	for (f = 0; f < MAXCPUS; f++) {
+		spinlock_init(&cm_pcpu[f].cp_lock);
+		cm_pcpu[f].cp_n = 0;
+	}
+	cm_nzero = 0;
+	cm_hand = 0;
+
+	coremap = (struct coremap_entry *)PADDR_TO_KVADDR(lo);
+
+	/* Push in reverse so that low frames are handed out first. */
+	for (f = cm_nframes; f > 0; f--) {
+		cm_push(f - 1, false);
+	}
+
+	spinlock_release(&coremap_lock);
+
+	cm_wchan = wchan_create("coremap");
+	if (cm_wchan == NULL) {
+		panic("coremap: wchan_create failed\n");
+	}
+
+	kprintf("coremap: %u frames (%uk) managed\n",
+		cm_nframes, cm_nframes * PAGE_SIZE / 1024);
+}
+
+/*
+ * Find NPAGES contiguous free frames. Returns CM_NONE if there is no
+ * such run.
+ */
+static
+uint32_t
+cm_find_run(uint32_t npages)
+{
+	uint32_t start, f;
+
+	start = 0;
+	while (start + npages <= cm_nframes) {
+		for (f = start; f < start + npages; f++) {
+			if (coremap[f].cme_state != CME_FREE) {
+				break;
+			}
+		}
+		if (f == start + npages) {
+			return start;
+		}
+		start = f + 1;
+	}
+	return CM_NONE;
+}
+
+/*
+ * Hand out the NPAGES free frames starting at START.
+ */
+static
+void
+cm_take(uint32_t start, uint32_t npages, bool kernel)
+{
+	uint32_t f;
+
+	for (f = start; f < start + npages; f++) {
+		cm_unlink(f);
+		coremap[f].cme_state = kernel ? CME_KERNEL : CME_USER;
+		coremap[f].cme_refcount = 0;
+		coremap[f].cme_npages = 0;
+	}
+	coremap[start].cme_refcount = 1;
+	coremap[start].cme_npages = npages;
+	if (!kernel) {
+		coremap[start].cme_flags = CMF_BUSY;
+	}
+	cm_nfree -= npages;
+}
+
+/*
+ * Take a frame from this CPU's cache, refilling it from the free list
+ * if it is empty. Returns CM_NONE if that is empty too.
+ */
+static
+uint32_t
+cm_pcpu_take(void)
+{
+	struct cm_pcpu *cp;
+	uint32_t f;
+
+	/* If we move to another CPU meanwhile, the lock still covers us. */
+	cp = &cm_pcpu[curcpu->c_number];
+	spinlock_acquire(&cp->cp_lock);
+
+	f = CM_NONE;
+	if (cp->cp_n == 0) {
+		spinlock_acquire(&coremap_lock);
+		while (cp->cp_n < CM_PCPU_BATCH && cm_freehead != CM_NONE) {
+			f = cm_freehead;
+			cm_unlink(f);
+			coremap[f].cme_state = CME_CACHED;
+			coremap[f].cme_flags = CMF_BUSY;
+			cm_nfree--;
+			cp->cp_frames[cp->cp_n++] = f;
+		}
+		spinlock_release(&coremap_lock);
+	}
+	if (cp->cp_n > 0) {
+		f = cp->cp_frames[--cp->cp_n];
+	}
+
+	spinlock_release(&cp->cp_lock);
+	return f;
+}
+
+/*
+ * Put the cached frame F in this CPU's cache, draining some of it to
+ * the free list if it is full.
+ */
+static
+void
+cm_pcpu_put(uint32_t f)
+{
+	struct cm_pcpu *cp;
+	unsigned i;
+
+	cp = &cm_pcpu[curcpu->c_number];
+	spinlock_acquire(&cp->cp_lock);
+
+	if (cp->cp_n == CM_PCPU_MAX) {
+		spinlock_acquire(&coremap_lock);
+		for (i = 0; i < CM_PCPU_BATCH; i++) {
+			cm_push(cp->cp_frames[--cp->cp_n], false);
+		}
+		cm_nfree += CM_PCPU_BATCH;
+		spinlock_release(&coremap_lock);
+	}
+	cp->cp_frames[cp->cp_n++] = f;
+
+	spinlock_release(&cp->cp_lock);
+}
+
+/*
+ * Make the single page frame E, which nobody else can reach any more,
+ * ready to go in a per-CPU cache.
+ */
+static
+void
+cm_setcached(struct coremap_entry *e)
+{
+	e->cme_state = CME_CACHED;
+	e->cme_flags = CMF_BUSY;
+	e->cme_refcount = 0;
+	e->cme_npages = 0;
+	e->cme_as = NULL;
+	e->cme_vaddr = 0;
+	e->cme_swapslot = SWAP_NOSLOT;
+}
+
+/*
+ * Return every CPU's cached frames to the free list. Returns false if
+ * there were none.
+ */
+static
+bool
+cm_pcpu_reclaim(void)
+{
+	struct cm_pcpu *cp;
+	unsigned i, n;
+
+	n = 0;
+	for (i = 0; i < MAXCPUS; i++) {
+		cp = &cm_pcpu[i];
+		spinlock_acquire(&cp->cp_lock);
+		spinlock_acquire(&coremap_lock);
+		while (cp->cp_n > 0) {
+			cm_push(cp->cp_frames[--cp->cp_n], false);
+			cm_nfree++;
+			n++;
+		}
+		spinlock_release(&coremap_lock);
+		spinlock_release(&cp->cp_lock);
+	}
+	return n > 0;
+}
+
+paddr_t
+coremap_alloc(unsigned npages, bool kernel)
+{
+	struct coremap_entry *e;
+	uint32_t start;
+	paddr_t pa;
+	bool reclaimed;
+
+	KASSERT(npages > 0);
+	KASSERT(kernel || npages == 1);
+
+	if (npages == 1 && coremap != NULL) {
+		start = cm_pcpu_take();
+		if (start != CM_NONE) {
+			e = &coremap[start];
+			KASSERT(e->cme_state == CME_CACHED);
+			e->cme_refcount = 1;
+			e->cme_npages = 1;
+			e->cme_as = NULL;
+			e->cme_vaddr = 0;
+			e->cme_swapslot = SWAP_NOSLOT;
+			e->cme_flags = kernel ? 0 : CMF_BUSY;
+			e->cme_state = kernel ? CME_KERNEL : CME_USER;
+			return CM_PADDR(start);
+		}
+	}
+
+	reclaimed = false;
+	for (;;) {
+		spinlock_acquire(&coremap_lock);
+
+		if (coremap == NULL) {
+			/* Too early in boot; nothing stolen here is freed. */
+			pa = ram_stealmem(npages);
+			spinlock_release(&coremap_lock);
+			return pa;
+		}
+
+		start = CM_NONE;
+		if (npages == 1) {
+			/* Save the zeroed frames for those who need them. */
+			start = cm_freehead != CM_NONE ?
+				cm_freehead : cm_zerohead;
+		}
+		else if (npages <= cm_nfree) {
+			start = cm_find_run(npages);
+		}
+		if (start != CM_NONE) {
+			break;
+		}
+
+		spinlock_release(&coremap_lock);
+
+		/* What we need may be sitting in the CPUs' caches. */
+		if (reclaimed || !cm_pcpu_reclaim()) {
+			return 0;
+		}
+		reclaimed = true;
+	}
+
+	cm_take(start, npages, kernel);
+
+	spinlock_release(&coremap_lock);
+
+	return CM_PADDR(start);
+}
+
+paddr_t
+coremap_alloc_zeroed(void)
+{
+	uint32_t f;
+
+	spinlock_acquire(&coremap_lock);
+	if (coremap == NULL || cm_zerohead == CM_NONE) {
+		spinlock_release(&coremap_lock);
+		return 0;
+	}
+	f = cm_zerohead;
+	cm_take(f, 1, false);
+	spinlock_release(&coremap_lock);
+
+	return CM_PADDR(f);
+}
+
+bool
+coremap_zero_one(void)
+{
+	uint32_t f;
+
+	spinlock_acquire(&coremap_lock);
+	if (coremap == NULL || cm_nzero >= CM_ZEROPOOL ||
+	    cm_freehead == CM_NONE) {
+		spinlock_release(&coremap_lock);
+		return false;
+	}
+	f = cm_freehead;
+	cm_unlink(f);
+	coremap[f].cme_state = CME_ZEROING;
+	cm_nfree--;
+	spinlock_release(&coremap_lock);
+
+	bzero((void *)PADDR_TO_KVADDR(CM_PADDR(f)), PAGE_SIZE);
+
+	spinlock_acquire(&coremap_lock);
+	cm_push(f, true);
+	cm_nfree++;
+	spinlock_release(&coremap_lock);
+
+	return true;
+}
+
+bool
+coremap_owns(paddr_t paddr)
+{
+	return coremap != NULL && paddr >= cm_base &&
+		CM_FRAME(paddr) < cm_nframes;
+}
+
+void
+coremap_free(paddr_t paddr)
+{
+	struct coremap_entry *e;
+	uint32_t start, npages, f;
+	bool tocache;
+
+	KASSERT((paddr & PAGE_FRAME) == paddr);
+
+	if (!coremap_owns(paddr)) {
+		/* Stolen before the coremap existed; leak it. */
+		return;
+	}
+
+	start = CM_FRAME(paddr);
+	e = &coremap[start];
+
+	if (e->cme_state == CME_KERNEL && e->cme_npages == 1 &&
+	    e->cme_refcount == 1) {
+		/* Nobody else can see it; see above. */
+		cm_setcached(e);
+		cm_pcpu_put(start);
+		return;
+	}
+
+	spinlock_acquire(&coremap_lock);
+
+	KASSERT(e->cme_state != CME_FREE);
+	KASSERT(e->cme_npages > 0);
+	KASSERT(e->cme_refcount > 0);
+
+	/* User frames are freed by whoever has them pinned. */
+	if (e->cme_flags & CMF_BUSY) {
+		e->cme_flags &= ~CMF_BUSY;
+		wchan_wakeall(cm_wchan);
+	}
+
+	tocache = false;
+	e->cme_refcount--;
+	if (e->cme_refcount == 0) {
+		if (e->cme_swapslot != SWAP_NOSLOT) {
+			swap_free(e->cme_swapslot);
+		}
+		npages = e->cme_npages;
+		if (npages == 1) {
+			cm_setcached(e);
+			tocache = true;
+		}
+		else {
+			for (f = start + npages; f > start; f--) {
+				cm_push(f - 1, false);
+			}
+			cm_nfree += npages;
+		}
+	}
+
+	spinlock_release(&coremap_lock);
+
+	if (tocache) {
+		cm_pcpu_put(start);
+	}
+}
+
+void
+coremap_incref(paddr_t paddr)
+{
+	struct coremap_entry *e;
+
+	KASSERT(coremap_owns(paddr));
+	e = &coremap[CM_FRAME(paddr)];
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(e->cme_state == CME_USER);
+	KASSERT(e->cme_refcount > 0);
+	e->cme_refcount++;
+	/* Shared frames are not evicted. */
+	e->cme_as = NULL;
+	spinlock_release(&coremap_lock);
+}
+
+unsigned
+coremap_refcount(paddr_t paddr)
+{
+	unsigned count;
+
+	KASSERT(coremap_owns(paddr));
+
+	spinlock_acquire(&coremap_lock);
+	count = coremap[CM_FRAME(paddr)].cme_refcount;
+	spinlock_release(&coremap_lock);
+	return count;
+}
+
+bool
+coremap_pin(paddr_t paddr)
+{
+	struct coremap_entry *e;
+
+	KASSERT(coremap_owns(paddr));
+	e = &coremap[CM_FRAME(paddr)];
+
+	spinlock_acquire(&coremap_lock);
+	if (e->cme_state != CME_USER) {
+		/* Freed under the caller; it will see the new PTE. */
+		spinlock_release(&coremap_lock);
+		return false;
+	}
+	if (e->cme_flags & CMF_BUSY) {
+		wchan_lock(cm_wchan);
+		spinlock_release(&coremap_lock);
+		wchan_sleep(cm_wchan);
+		return false;
+	}
+	e->cme_flags |= CMF_BUSY;
+	spinlock_release(&coremap_lock);
+	return true;
+}
+
+void
+coremap_unpin(paddr_t paddr)
+{
+	struct coremap_entry *e;
+
+	KASSERT(coremap_owns(paddr));
+	e = &coremap[CM_FRAME(paddr)];
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(e->cme_flags & CMF_BUSY);
+	e->cme_flags &= ~CMF_BUSY;
+	wchan_wakeall(cm_wchan);
+	spinlock_release(&coremap_lock);
+}
+
+void
+coremap_claim(paddr_t paddr, struct addrspace *as, vaddr_t vaddr)
+{
+	struct coremap_entry *e;
+
+	KASSERT(coremap_owns(paddr));
+	e = &coremap[CM_FRAME(paddr)];
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(e->cme_state == CME_USER);
+	KASSERT(e->cme_flags & CMF_BUSY);
+	if (e->cme_refcount == 1) {
+		e->cme_as = as;
+		e->cme_vaddr = vaddr;
+	}
+	spinlock_release(&coremap_lock);
+}
+
+void
+coremap_setslot(paddr_t paddr, unsigned slot)
+{
+	struct coremap_entry *e;
+
+	KASSERT(coremap_owns(paddr));
+	e = &coremap[CM_FRAME(paddr)];
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(e->cme_flags & CMF_BUSY);
+	KASSERT(e->cme_swapslot == SWAP_NOSLOT);
+	e->cme_swapslot = slot;
+	spinlock_release(&coremap_lock);
+}
+
+void
+coremap_settext(paddr_t paddr)
+{
+	struct coremap_entry *e;
+
+	KASSERT(coremap_owns(paddr));
+	e = &coremap[CM_FRAME(paddr)];
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(e->cme_flags & CMF_BUSY);
+	e->cme_flags |= CMF_TEXT;
+	spinlock_release(&coremap_lock);
+}
+
+void
+coremap_setfile(paddr_t paddr)
+{
+	struct coremap_entry *e;
+
+	KASSERT(coremap_owns(paddr));
+	e = &coremap[CM_FRAME(paddr)];
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(e->cme_flags & CMF_BUSY);
+	e->cme_flags |= CMF_FILE;
+	spinlock_release(&coremap_lock);
+}
+
+void
+coremap_dirty(paddr_t paddr)
+{
+	struct coremap_entry *e;
+
+	KASSERT(coremap_owns(paddr));
+	e = &coremap[CM_FRAME(paddr)];
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(e->cme_flags & CMF_BUSY);
+	if (e->cme_swapslot != SWAP_NOSLOT) {
+		swap_free(e->cme_swapslot);
+		e->cme_swapslot = SWAP_NOSLOT;
+	}
+	spinlock_release(&coremap_lock);
+}
+
+/*
+ * Victims are chosen by the clock algorithm. The hand sweeps over the
+ * frames; an evictable frame whose page has been referenced since the
+ * hand last passed (PTE_VALID is set) gets a second chance: the bit is
+ * cleared, and the page recorded in REFS so that the caller can shoot
+ * down its translations. Otherwise it is taken.
+ *
+ * Second-chance frames are pinned too, until the caller has shot them
+ * down, so that their address spaces can't be destroyed while the
+ * shootdown is looking at them.
+ *
+ * The page table entry of an evictable frame can be looked at with
+ * coremap_lock held, because nobody changes it without first pinning
+ * the frame.
+ */
+unsigned
+coremap_pick_victims(struct cm_victim *victims, unsigned max,
+		     struct tlbshootdown *refs, paddr_t *refframes,
+		     unsigned maxrefs, unsigned *nrefs)
+{
+	struct coremap_entry *e;
+	unsigned n;
+	uint32_t i;
+	pte_t *pte;
+
+	n = 0;
+	*nrefs = 0;
+
+	spinlock_acquire(&coremap_lock);
+	for (i = 0; i < cm_nframes && n < max; i++) {
+		e = &coremap[cm_hand];
+		if (e->cme_state == CME_USER && e->cme_refcount == 1 &&
+		    e->cme_as != NULL && (e->cme_flags & CMF_BUSY) == 0) {
+			pte = pt_lookup(e->cme_as->as_pt, e->cme_vaddr, false);
+			KASSERT(pte != NULL);
+			KASSERT((*pte & PTE_FRAME) == CM_PADDR(cm_hand));
+			if (*pte & PTE_VALID) {
+				if (*nrefs == maxrefs) {
+					/* Come back to it next time. */
+					break;
+				}
+				*pte &= ~PTE_VALID;
+				e->cme_flags |= CMF_BUSY;
+				refframes[*nrefs] = CM_PADDR(cm_hand);
+				refs[*nrefs].ts_addrspace = e->cme_as;
+				refs[*nrefs].ts_vaddr = e->cme_vaddr;
+				(*nrefs)++;
+				cm_hand = (cm_hand + 1) % cm_nframes;
+				continue;
+			}
+			e->cme_flags |= CMF_BUSY;
+			victims[n].cv_paddr = CM_PADDR(cm_hand);
+			victims[n].cv_as = e->cme_as;
+			victims[n].cv_vaddr = e->cme_vaddr;
+			victims[n].cv_swapslot = e->cme_swapslot;
+			victims[n].cv_text = (e->cme_flags & CMF_TEXT) != 0;
+			victims[n].cv_file = (e->cme_flags & CMF_FILE) != 0;
+			n++;
+		}
+		cm_hand = (cm_hand + 1) % cm_nframes;
+	}
+	spinlock_release(&coremap_lock);
+
+	return n;
+}
+
+void
+coremap_evicted(paddr_t paddr)
+{
+	struct coremap_entry *e;
+	uint32_t f;
+
+	KASSERT(coremap_owns(paddr));
+	f = CM_FRAME(paddr);
+	e = &coremap[f];
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(e->cme_state == CME_USER);
+	KASSERT(e->cme_refcount == 1);
+	KASSERT(e->cme_flags & CMF_BUSY);
+	/* The swap slot, if any, now belongs to the page table. */
+	e->cme_swapslot = SWAP_NOSLOT;
+	cm_push(f, false);
+	cm_nfree++;
+	wchan_wakeall(cm_wchan);
+	spinlock_release(&coremap_lock);
+}
+
+void
+coremap_printstats(void)
+{
+	uint32_t f, nfree, nzero, ncached, nkern, nuser;
+
+	ncached = nkern = nuser = 0;
+
+	spinlock_acquire(&coremap_lock);
+	for (f = 0; f < cm_nframes; f++) {
+		if (coremap[f].cme_state == CME_KERNEL) {
+			nkern++;
+		}
+		else if (coremap[f].cme_state == CME_USER) {
+			nuser++;
+		}
+		else if (coremap[f].cme_state == CME_CACHED) {
+			ncached++;
+		}
+	}
+	nfree = cm_nfree;
+	nzero = cm_nzero;
+	spinlock_release(&coremap_lock);
+
+	kprintf("Coremap: %u frames, %u free (%u zeroed, %u cached), "
+		"%u kernel, %u user\n", cm_nframes, nfree + ncached, nzero,
+		ncached, nkern, nuser);
+}
@@ -0,0 +1,359 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <vnode.h>
+#include <elf.h>
+#include <coremap.h>
+#include <textcache.h>
+#include <execcache.h>
+
+/*
+ * Executable image cache. See execcache.h.
+ *
+ * Each entry holds a reference to its vnode, so that the vnode can't
+ * be reused for some other file while it is cached, and an array of
+ * the frames it has kept, one slot for each page of the executable's
+ * read-only segments.
+ *
+ * ec_lock can't be held while sleeping, so frames and vnodes are let
+ * go of only after they have been taken out of the table. Lock order:
+ * ec_lock, then tc_lock, then coremap_lock.
+ */
+
+struct ec_entry {
+	struct vnode *ee_vnode;		/* NULL if the entry is free */
+	unsigned ee_lastuse;		/* ec_clock when last looked up */
+	struct execcache_image ee_image;
+	paddr_t *ee_frames;		/* frames kept, or 0 */
+	unsigned ee_nframes;
+};
+
+static struct spinlock ec_lock = SPINLOCK_INITIALIZER;
+static struct ec_entry ec_entries[EXECCACHE_NENTRIES];
+static unsigned ec_clock;
+
+/*
+ * Return the number of pages of ES that are shared through the text
+ * cache: all of them if it is read-only, otherwise none.
+ */
+static
+unsigned
+ec_segpages(const struct execcache_seg *es)
+{
+	vaddr_t base, top;
+
+	if (es->es_flags & PF_W) {
+		return 0;
+	}
+	base = es->es_vaddr & PAGE_FRAME;
+	top = ROUNDUP(es->es_vaddr + es->es_memsz, PAGE_SIZE);
+	return (top - base) / PAGE_SIZE;
+}
+
+/*
+ * Return the slot for page VADDR of image EI, or -1 if it is not in a
+ * read-only segment.
+ */
+static
+int
+ec_slot(const struct execcache_image *ei, vaddr_t vaddr)
+{
+	unsigned i, n, slot;
+	vaddr_t base;
+
+	slot = 0;
+	for (i = 0; i < ei->ei_nsegs; i++) {
+		n = ec_segpages(&ei->ei_segs[i]);
+		base = ei->ei_segs[i].es_vaddr & PAGE_FRAME;
+		if (vaddr >= base && vaddr < base + n * PAGE_SIZE) {
+			return slot + (vaddr - base) / PAGE_SIZE;
+		}
+		slot += n;
+	}
+	return -1;
+}
+
+/*
+ * Return the page whose frame goes in slot SLOT of image EI.
+ */
+static
+vaddr_t
+ec_slotaddr(const struct execcache_image *ei, unsigned slot)
+{
+	unsigned i, n;
+
+	for (i = 0; i < ei->ei_nsegs; i++) {
+		n = ec_segpages(&ei->ei_segs[i]);
+		if (slot < n) {
+			return (ei->ei_segs[i].es_vaddr & PAGE_FRAME) +
+				slot * PAGE_SIZE;
+		}
+		slot -= n;
+	}
+	panic("execcache: slot out of range\n");
+}
+
+/*
+ * Find the entry for V. Called with ec_lock held.
+ */
+static
+struct ec_entry *
+ec_find(struct vnode *v)
+{
+	unsigned i;
+
+	for (i = 0; i < EXECCACHE_NENTRIES; i++) {
+		if (ec_entries[i].ee_vnode == v) {
+			return &ec_entries[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Give back the frame PADDR, kept for page VADDR of V.
+ */
+static
+void
+ec_putframe(struct vnode *v, vaddr_t vaddr, paddr_t paddr)
+{
+	/* We hold a reference, so it is still a user frame. */
+	while (!coremap_pin(paddr)) {
+		/* nothing */
+	}
+	textcache_release(v, vaddr, paddr);
+}
+
+/*
+ * Let go of everything held by EE, a copy of an entry that has been
+ * taken out of the table.
+ */
+static
+void
+ec_drop(struct ec_entry *ee)
+{
+	unsigned i;
+
+	for (i = 0; i < ee->ee_nframes; i++) {
+		if (ee->ee_frames[i] != 0) {
+			ec_putframe(ee->ee_vnode,
+				    ec_slotaddr(&ee->ee_image, i),
+				    ee->ee_frames[i]);
+		}
+	}
+	if (ee->ee_frames != NULL) {
+		kfree(ee->ee_frames);
+	}
+	VOP_DECREF(ee->ee_vnode);
+}
+
+bool
+execcache_lookup(struct vnode *v, struct execcache_image *image)
+{
+	struct ec_entry *ee;
+
+	spinlock_acquire(&ec_lock);
+	ee = ec_find(v);
+	if (ee != NULL) {
+		*image = ee->ee_image;
+		ee->ee_lastuse = ++ec_clock;
+	}
+	spinlock_release(&ec_lock);
+
+	return ee != NULL;
+}
+
+void
+execcache_enter(struct vnode *v, const struct execcache_image *image,
+		unsigned gen)
+{
+	struct ec_entry *ee;
+	struct ec_entry old;
+	paddr_t *frames;
+	unsigned nframes, i;
+
+	nframes = 0;
+	for (i = 0; i < image->ei_nsegs; i++) {
+		nframes += ec_segpages(&image->ei_segs[i]);
+	}
+
+	/* Allocate first; kmalloc can't be called with ec_lock held. */
+	frames = NULL;
+	if (nframes > 0) {
+		frames = kmalloc(nframes * sizeof(paddr_t));
+		if (frames == NULL) {
+			/* Not worth failing the exec over. */
+			return;
+		}
+		for (i = 0; i < nframes; i++) {
+			frames[i] = 0;
+		}
+	}
+	VOP_INCREF(v);
+
+	old.ee_vnode = NULL;
+
+	spinlock_acquire(&ec_lock);
+	/*
+	 * Checked with ec_lock held, so that an invalidation either has
+	 * advanced the generation already or will find the entry.
+	 */
+	if (ec_find(v) == NULL && textcache_gen(v) == gen) {
+		/* Take a free entry, or else the least recently used. */
+		ee = &ec_entries[0];
+		for (i = 0; i < EXECCACHE_NENTRIES; i++) {
+			if (ec_entries[i].ee_vnode == NULL) {
+				ee = &ec_entries[i];
+				break;
+			}
+			if (ec_entries[i].ee_lastuse < ee->ee_lastuse) {
+				ee = &ec_entries[i];
+			}
+		}
+		old = *ee;
+
+		ee->ee_vnode = v;
+		ee->ee_lastuse = ++ec_clock;
+		ee->ee_image = *image;
+		ee->ee_frames = frames;
+		ee->ee_nframes = nframes;
+		frames = NULL;
+		v = NULL;
+	}
+	spinlock_release(&ec_lock);
+
+	if (v != NULL) {
+		/* Someone else got there first, or the file changed. */
+		if (frames != NULL) {
+			kfree(frames);
+		}
+		VOP_DECREF(v);
+	}
+	if (old.ee_vnode != NULL) {
+		ec_drop(&old);
+	}
+}
+
+void
+execcache_keep(struct vnode *v, vaddr_t vaddr, paddr_t paddr)
+{
+	struct ec_entry *ee;
+	int slot;
+
+	spinlock_acquire(&ec_lock);
+	ee = ec_find(v);
+	if (ee != NULL) {
+		slot = ec_slot(&ee->ee_image, vaddr);
+		/* Not if the file has changed since it was read. */
+		if (slot >= 0 && ee->ee_frames[slot] == 0 &&
+		    textcache_current(v, vaddr, paddr)) {
+			ee->ee_frames[slot] = paddr;
+			coremap_incref(paddr);
+		}
+	}
+	spinlock_release(&ec_lock);
+}
+
+bool
+execcache_shrink(void)
+{
+	struct ec_entry *ee;
+	struct vnode *v;
+	vaddr_t vaddr;
+	paddr_t paddr;
+	unsigned i, slot, n;
+
+	/* Find the least recently used entry with frames. */
+	spinlock_acquire(&ec_lock);
+	ee = NULL;
+	for (i = 0; i < EXECCACHE_NENTRIES; i++) {
+		if (ec_entries[i].ee_vnode == NULL) {
+			continue;
+		}
+		for (slot = 0; slot < ec_entries[i].ee_nframes; slot++) {
+			if (ec_entries[i].ee_frames[slot] != 0) {
+				break;
+			}
+		}
+		if (slot < ec_entries[i].ee_nframes &&
+		    (ee == NULL ||
+		     ec_entries[i].ee_lastuse < ee->ee_lastuse)) {
+			ee = &ec_entries[i];
+		}
+	}
+	spinlock_release(&ec_lock);
+
+	if (ee == NULL) {
+		return false;
+	}
+
+	/*
+	 * Take its frames out one at a time. The entry may be reused
+	 * meanwhile; whatever it then holds is just as good to give up.
+	 */
+	n = 0;
+	slot = 0;
+	for (;;) {
+		spinlock_acquire(&ec_lock);
+		while (slot < ee->ee_nframes && ee->ee_frames[slot] == 0) {
+			slot++;
+		}
+		if (ee->ee_vnode == NULL || slot >= ee->ee_nframes) {
+			spinlock_release(&ec_lock);
+			break;
+		}
+		v = ee->ee_vnode;
+		vaddr = ec_slotaddr(&ee->ee_image, slot);
+		paddr = ee->ee_frames[slot];
+		ee->ee_frames[slot] = 0;
+		spinlock_release(&ec_lock);
+
+		ec_putframe(v, vaddr, paddr);
+		n++;
+	}
+	return n > 0;
+}
+
+void
+execcache_invalidate(struct vnode *v)
+{
+	struct ec_entry *ee;
+	struct ec_entry old;
+
+	/* New lookups mustn't find the old pages. */
+	textcache_invalidate(v);
+
+	spinlock_acquire(&ec_lock);
+	ee = ec_find(v);
+	if (ee == NULL) {
+		spinlock_release(&ec_lock);
+		return;
+	}
+	old = *ee;
+	ee->ee_vnode = NULL;
+	ee->ee_frames = NULL;
+	ee->ee_nframes = 0;
+	spinlock_release(&ec_lock);
+
+	ec_drop(&old);
+}
+
+void
+execcache_purge(void)
+{
+	struct ec_entry old;
+	unsigned i;
+
+	for (i = 0; i < EXECCACHE_NENTRIES; i++) {
+		spinlock_acquire(&ec_lock);
+		old = ec_entries[i];
+		ec_entries[i].ee_vnode = NULL;
+		ec_entries[i].ee_frames = NULL;
+		ec_entries[i].ee_nframes = 0;
+		spinlock_release(&ec_lock);
+
+		if (old.ee_vnode != NULL) {
+			ec_drop(&old);
+		}
+	}
+}
@@ -0,0 +1,281 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <uio.h>
+#include <vnode.h>
+#include <coremap.h>
+#include <pagecache.h>
+
+/*
+ * Page cache for mapped files. See pagecache.h.
+ *
+ * Entries are kept in a small hash table, like the text cache's, and
+ * under the same rule: reference counts on cached frames are only
+ * dropped with pc_lock held, so a lookup can never find a frame whose
+ * last reference is going away.
+ *
+ * Write-back happens without pc_lock, which can't be held across I/O.
+ * The dirty mark is cleared before the write starts, so that anyone
+ * who maps the page meanwhile and writes it marks it dirty again.
+ * Only the holder of the frame's pin takes an entry out of the cache,
+ * so the entry stays put while the write is going on.
+ */
+
+#define PC_HASHSIZE 64
+
+struct pc_entry {
+	struct pc_entry *pe_next;	/* hash chain */
+	struct vnode *pe_vnode;
+	off_t pe_offset;
+	paddr_t pe_paddr;
+	size_t pe_len;			/* bytes of it that are in the file */
+	bool pe_dirty;
+};
+
+static struct spinlock pc_lock = SPINLOCK_INITIALIZER;
+static struct pc_entry *pc_hash[PC_HASHSIZE];
+
+static
+unsigned
+pc_bucket(struct vnode *v, off_t offset)
+{
+	return (((uintptr_t)v >> 4) ^ (uint32_t)(offset >> 12)) % PC_HASHSIZE;
+}
+
+/*
+ * Find the entry for the page at OFFSET in V. Returns a pointer to the
+ * link that points to it, or to the NULL at the end of its chain.
+ */
+static
+struct pc_entry **
+pc_find(struct vnode *v, off_t offset)
+{
+	struct pc_entry **pep;
+
+	for (pep = &pc_hash[pc_bucket(v, offset)]; *pep != NULL;
+	     pep = &(*pep)->pe_next) {
+		if ((*pep)->pe_vnode == v && (*pep)->pe_offset == offset) {
+			break;
+		}
+	}
+	return pep;
+}
+
+/*
+ * Find the entry for frame PADDR, which must be cached.
+ */
+static
+struct pc_entry **
+pc_findframe(paddr_t paddr)
+{
+	struct pc_entry **pep;
+	unsigned i;
+
+	for (i = 0; i < PC_HASHSIZE; i++) {
+		for (pep = &pc_hash[i]; *pep != NULL; pep = &(*pep)->pe_next) {
+			if ((*pep)->pe_paddr == paddr) {
+				return pep;
+			}
+		}
+	}
+	panic("pagecache: frame 0x%x is not cached\n", paddr);
+}
+
+/*
+ * Write the first LEN bytes of frame PADDR to V at OFFSET.
+ */
+static
+int
+pc_write(struct vnode *v, off_t offset, size_t len, paddr_t paddr)
+{
+	struct iovec iov;
+	struct uio u;
+	int result;
+
+	uio_kinit(&iov, &u, (void *)PADDR_TO_KVADDR(paddr), len, offset,
+		  UIO_WRITE);
+	result = VOP_WRITE(v, &u);
+	if (result) {
+		return result;
+	}
+	KASSERT(u.uio_resid == 0);
+	return 0;
+}
+
+paddr_t
+pagecache_get(struct vnode *v, off_t offset)
+{
+	struct pc_entry *pe;
+	paddr_t pa;
+
+	pa = 0;
+
+	spinlock_acquire(&pc_lock);
+	pe = *pc_find(v, offset);
+	if (pe != NULL) {
+		pa = pe->pe_paddr;
+		coremap_incref(pa);
+	}
+	spinlock_release(&pc_lock);
+
+	return pa;
+}
+
+paddr_t
+pagecache_add(struct vnode *v, off_t offset, size_t len, paddr_t paddr)
+{
+	struct pc_entry *pe, *newpe;
+	struct pc_entry **pep;
+
+	KASSERT(len <= PAGE_SIZE);
+
+	/* Allocate first; kmalloc can't be called with pc_lock held. */
+	newpe = kmalloc(sizeof(struct pc_entry));
+
+	spinlock_acquire(&pc_lock);
+	pep = pc_find(v, offset);
+	pe = *pep;
+	if (pe != NULL) {
+		paddr = pe->pe_paddr;
+		coremap_incref(paddr);
+	}
+	else if (newpe != NULL) {
+		newpe->pe_next = NULL;
+		newpe->pe_vnode = v;
+		newpe->pe_offset = offset;
+		newpe->pe_paddr = paddr;
+		newpe->pe_len = len;
+		newpe->pe_dirty = false;
+		*pep = newpe;
+		coremap_setfile(paddr);
+		newpe = NULL;
+	}
+	else {
+		/* Unlike text, a mapped page must be findable. */
+		paddr = 0;
+	}
+	spinlock_release(&pc_lock);
+
+	if (newpe != NULL) {
+		kfree(newpe);
+	}
+	return paddr;
+}
+
+void
+pagecache_dirty(struct vnode *v, off_t offset)
+{
+	struct pc_entry *pe;
+
+	spinlock_acquire(&pc_lock);
+	pe = *pc_find(v, offset);
+	KASSERT(pe != NULL);
+	pe->pe_dirty = true;
+	spinlock_release(&pc_lock);
+}
+
+int
+pagecache_sync(struct vnode *v, off_t offset, paddr_t paddr)
+{
+	struct pc_entry *pe;
+	size_t len;
+	bool dirty;
+
+	spinlock_acquire(&pc_lock);
+	pe = *pc_find(v, offset);
+	KASSERT(pe != NULL && pe->pe_paddr == paddr);
+	dirty = pe->pe_dirty;
+	len = pe->pe_len;
+	spinlock_release(&pc_lock);
+
+	if (!dirty) {
+		return 0;
+	}
+	return pc_write(v, offset, len, paddr);
+}
+
+void
+pagecache_release(struct vnode *v, off_t offset, paddr_t paddr)
+{
+	struct pc_entry **pep;
+	struct pc_entry *pe;
+	size_t len;
+	int result;
+
+	for (;;) {
+		spinlock_acquire(&pc_lock);
+		pep = pc_find(v, offset);
+		pe = *pep;
+		KASSERT(pe != NULL && pe->pe_paddr == paddr);
+		if (!pe->pe_dirty || coremap_refcount(paddr) > 1) {
+			break;
+		}
+
+		/* The last mapping is going; save what it wrote. */
+		pe->pe_dirty = false;
+		len = pe->pe_len;
+		spinlock_release(&pc_lock);
+
+		result = pc_write(v, offset, len, paddr);
+		if (result) {
+			kprintf("pagecache: write-back failed: %s\n",
+				strerror(result));
+		}
+	}
+
+	if (coremap_refcount(paddr) == 1) {
+		*pep = pe->pe_next;
+	}
+	else {
+		pe = NULL;
+	}
+	coremap_free(paddr);
+	spinlock_release(&pc_lock);
+
+	if (pe != NULL) {
+		kfree(pe);
+	}
+}
+
+bool
+pagecache_evict(paddr_t paddr)
+{
+	struct pc_entry **pep;
+	struct pc_entry *pe;
+	int result;
+
+	spinlock_acquire(&pc_lock);
+	pe = *pc_findframe(paddr);
+	if (coremap_refcount(paddr) != 1) {
+		spinlock_release(&pc_lock);
+		return false;
+	}
+
+	if (pe->pe_dirty) {
+		pe->pe_dirty = false;
+		spinlock_release(&pc_lock);
+
+		result = pc_write(pe->pe_vnode, pe->pe_offset, pe->pe_len,
+				  paddr);
+
+		spinlock_acquire(&pc_lock);
+		if (result) {
+			pe->pe_dirty = true;
+			spinlock_release(&pc_lock);
+			return false;
+		}
+		if (coremap_refcount(paddr) != 1) {
+			/* Mapped again while we were writing. */
+			spinlock_release(&pc_lock);
+			return false;
+		}
+	}
+
+	pep = pc_find(pe->pe_vnode, pe->pe_offset);
+	KASSERT(*pep == pe);
+	*pep = pe->pe_next;
+	spinlock_release(&pc_lock);
+
+	kfree(pe);
+	return true;
+}
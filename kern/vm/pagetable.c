@@ -0,0 +1,61 @@
+#include <types.h>
+#include <lib.h>
+#include <pagetable.h>
+
+/*
+ * Two-level page table. See pagetable.h.
+ */
+
+struct pagetable *
+pt_create(void)
+{
+	struct pagetable *pt;
+
+	pt = kmalloc(sizeof(struct pagetable));
+	if (pt == NULL) {
+		return NULL;
+	}
+	bzero(pt, sizeof(struct pagetable));
+	return pt;
+}
+
+void
+pt_destroy(struct pagetable *pt)
+{
+	unsigned i;
+
+	KASSERT(pt != NULL);
+
+	for (i = 0; i < PT_L1_SIZE; i++) {
+		if (pt->pt_dir[i] != NULL) {
+			kfree(pt->pt_dir[i]);
+		}
+	}
+	kfree(pt);
+}
+
+pte_t *
+pt_lookup(struct pagetable *pt, vaddr_t vaddr, bool create)
+{
+	pte_t *table;
+
+	KASSERT(pt != NULL);
+
+	if (vaddr >= USERSPACETOP) {
+		return NULL;
+	}
+
+	table = pt->pt_dir[PT_L1_INDEX(vaddr)];
+	if (table == NULL) {
+		if (!create) {
+			return NULL;
+		}
+		table = kmalloc(PT_L2_SIZE * sizeof(pte_t));
+		if (table == NULL) {
+			return NULL;
+		}
+		bzero(table, PT_L2_SIZE * sizeof(pte_t));
+		pt->pt_dir[PT_L1_INDEX(vaddr)] = table;
+	}
+	return &table[PT_L2_INDEX(vaddr)];
+}
@@ -0,0 +1,328 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <stat.h>
+#include <bitmap.h>
+#include <spinlock.h>
+#include <uio.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <addrspace.h>
+#include <pagetable.h>
+#include <coremap.h>
+#include <swap.h>
+#include <textcache.h>
+#include <pagecache.h>
+#include <zcache.h>
+#include <uw-vmstats.h>
+
+/*
+ * Swap space and page replacement. See swap.h.
+ *
+ * Victims are chosen by the coremap's replacement clock
+ * (coremap_pick_victims), which hands back up to SWAP_CLUSTER
+ * evictable frames that have not been used lately, already pinned. They
+ * are all unmapped and then shot down together, so that their owners
+ * will fault and wait for the pin rather than keep using them. Dirty pages are then
+ * offered to the compressed cache (zcache.h), and those it won't take
+ * are written to contiguous slots in a single I/O; pages that were read
+ * back from swap and not written since still have their slot and are
+ * just dropped. So are text pages, which are read back from the
+ * executable, and pages of mapped files, which are written back to the
+ * file first if they are dirty.
+ */
+
+static struct vnode *swap_vnode;	/* NULL if there is no swap */
+static unsigned swap_nslots;
+
+/* swap_lock protects swap_map. */
+static struct spinlock swap_lock = SPINLOCK_INITIALIZER;
+static struct bitmap *swap_map;
+
+void
+swap_bootstrap(void)
+{
+	struct stat st;
+	char *path;
+	int result;
+
+	path = kstrdup(SWAP_DEVICE);
+	if (path == NULL) {
+		panic("swap: out of memory\n");
+	}
+	result = vfs_open(path, O_RDWR, 0, &swap_vnode);
+	kfree(path);
+	if (result) {
+		kprintf("swap: %s: %s; paging disabled\n", SWAP_DEVICE,
+			strerror(result));
+		swap_vnode = NULL;
+		return;
+	}
+
+	result = VOP_STAT(swap_vnode, &st);
+	if (result) {
+		panic("swap: stat %s: %s\n", SWAP_DEVICE, strerror(result));
+	}
+	swap_nslots = st.st_size / PAGE_SIZE;
+
+	swap_map = bitmap_create(swap_nslots);
+	if (swap_map == NULL) {
+		panic("swap: out of memory\n");
+	}
+
+	kprintf("swap: %s, %u slots (%uk)\n", SWAP_DEVICE, swap_nslots,
+		swap_nslots * PAGE_SIZE / 1024);
+}
+
+/*
+ * Allocate NSLOTS contiguous slots.
+ */
+static
+int
+swap_alloc_run(unsigned nslots, unsigned *ret)
+{
+	unsigned start, i;
+
+	spinlock_acquire(&swap_lock);
+	start = 0;
+	while (start + nslots <= swap_nslots) {
+		for (i = start; i < start + nslots; i++) {
+			if (bitmap_isset(swap_map, i)) {
+				break;
+			}
+		}
+		if (i == start + nslots) {
+			for (i = start; i < start + nslots; i++) {
+				bitmap_mark(swap_map, i);
+			}
+			spinlock_release(&swap_lock);
+			*ret = start;
+			return 0;
+		}
+		start = i + 1;
+	}
+	spinlock_release(&swap_lock);
+	return ENOSPC;
+}
+
+void
+swap_free(unsigned slot)
+{
+	KASSERT(slot < swap_nslots);
+
+	spinlock_acquire(&swap_lock);
+	KASSERT(bitmap_isset(swap_map, slot));
+	bitmap_unmark(swap_map, slot);
+	spinlock_release(&swap_lock);
+}
+
+int
+swap_in(unsigned slot, paddr_t paddr)
+{
+	struct iovec iov;
+	struct uio u;
+	int result;
+
+	KASSERT(swap_vnode != NULL);
+	KASSERT(slot < swap_nslots);
+
+	uio_kinit(&iov, &u, (void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE,
+		  (off_t)slot * PAGE_SIZE, UIO_READ);
+	result = VOP_READ(swap_vnode, &u);
+	if (result) {
+		return result;
+	}
+	KASSERT(u.uio_resid == 0);
+
+	vmstats_inc(VMSTAT_SWAP_FILE_READ);
+	return 0;
+}
+
+/*
+ * Write the N victims listed in WHICH to swap, in one I/O if there is
+ * a run of free slots long enough, and record their slots.
+ */
+static
+int
+swap_write(struct cm_victim *victims, unsigned *which, unsigned n)
+{
+	struct iovec iov[SWAP_CLUSTER];
+	struct uio u;
+	unsigned slot, i;
+	int result;
+
+	KASSERT(n > 0 && n <= SWAP_CLUSTER);
+
+	result = swap_alloc_run(n, &slot);
+	if (result) {
+		if (n == 1) {
+			return result;
+		}
+		/* Too fragmented; go one page at a time. */
+		for (i = 0; i < n; i++) {
+			result = swap_write(victims, which + i, 1);
+			if (result) {
+				return result;
+			}
+		}
+		return 0;
+	}
+
+	for (i = 0; i < n; i++) {
+		iov[i].iov_kbase =
+			(void *)PADDR_TO_KVADDR(victims[which[i]].cv_paddr);
+		iov[i].iov_len = PAGE_SIZE;
+	}
+	u.uio_iov = iov;
+	u.uio_iovcnt = n;
+	u.uio_offset = (off_t)slot * PAGE_SIZE;
+	u.uio_resid = n * PAGE_SIZE;
+	u.uio_segflg = UIO_SYSSPACE;
+	u.uio_rw = UIO_WRITE;
+	u.uio_space = NULL;
+
+	result = VOP_WRITE(swap_vnode, &u);
+	if (result) {
+		for (i = 0; i < n; i++) {
+			swap_free(slot + i);
+		}
+		return result;
+	}
+
+	for (i = 0; i < n; i++) {
+		victims[which[i]].cv_swapslot = slot + i;
+		vmstats_inc(VMSTAT_SWAP_FILE_WRITE);
+	}
+	return 0;
+}
+
+/*
+ * Unpin the N frames the clock passed over, once their translations
+ * have been shot down.
+ */
+static
+void
+swap_unpin_refs(const paddr_t *refframes, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		coremap_unpin(refframes[i]);
+	}
+}
+
+int
+swap_evict(void)
+{
+	struct cm_victim victims[SWAP_CLUSTER];
+	struct tlbshootdown ts[SWAP_CLOCKREFS + SWAP_CLUSTER];
+	paddr_t refframes[SWAP_CLOCKREFS];
+	struct tlbshootdown *vts;
+	unsigned dirty[SWAP_CLUSTER];
+	unsigned zc[SWAP_CLUSTER];
+	bool zcmiss[SWAP_CLUSTER];
+	pte_t *ptes[SWAP_CLUSTER];
+	pte_t saved[SWAP_CLUSTER];
+	unsigned n, nrefs, ndirty, nwrite, nfreed, i;
+	int result;
+
+	/*
+	 * Go round until the clock finds something that has not been
+	 * used lately. Pages it passes over are shot down along with
+	 * the victims, so that their next use is noticed.
+	 */
+	for (;;) {
+		n = coremap_pick_victims(victims, SWAP_CLUSTER, ts, refframes,
+					 SWAP_CLOCKREFS, &nrefs);
+		if (n > 0) {
+			break;
+		}
+		if (nrefs == 0) {
+			return ENOMEM;
+		}
+		vm_tlb_shootdown(ts, nrefs);
+		swap_unpin_refs(refframes, nrefs);
+	}
+	vts = ts + nrefs;
+
+	ndirty = 0;
+	for (i = 0; i < n; i++) {
+		ptes[i] = pt_lookup(victims[i].cv_as->as_pt,
+				    victims[i].cv_vaddr, false);
+		KASSERT(ptes[i] != NULL);
+		KASSERT(*ptes[i] & PTE_PRESENT);
+		KASSERT((*ptes[i] & PTE_FRAME) == victims[i].cv_paddr);
+
+		saved[i] = *ptes[i];
+		*ptes[i] &= ~(PTE_VALID | PTE_WRITE);
+		zc[i] = ZCACHE_NOENTRY;
+		zcmiss[i] = false;
+		vts[i].ts_addrspace = victims[i].cv_as;
+		vts[i].ts_vaddr = victims[i].cv_vaddr;
+
+		if (!victims[i].cv_text && !victims[i].cv_file &&
+		    victims[i].cv_swapslot == SWAP_NOSLOT) {
+			dirty[ndirty++] = i;
+		}
+	}
+	vm_tlb_shootdown(ts, nrefs + n);
+	swap_unpin_refs(refframes, nrefs);
+
+	nwrite = 0;
+	for (i = 0; i < ndirty; i++) {
+		if (zcache_store(victims[dirty[i]].cv_paddr,
+				 &zc[dirty[i]]) != 0) {
+			zcmiss[dirty[i]] = true;
+			dirty[nwrite++] = dirty[i];
+		}
+	}
+
+	result = 0;
+	if (nwrite > 0) {
+		result = swap_vnode != NULL ?
+			swap_write(victims, dirty, nwrite) : ENOSPC;
+	}
+
+	nfreed = 0;
+	for (i = 0; i < n; i++) {
+		if (victims[i].cv_text || victims[i].cv_file) {
+			if (victims[i].cv_text ?
+			    !textcache_evict(victims[i].cv_paddr) :
+			    !pagecache_evict(victims[i].cv_paddr)) {
+				/* Shared since we picked it, or unwritable. */
+				*ptes[i] = saved[i];
+				coremap_unpin(victims[i].cv_paddr);
+				continue;
+			}
+			*ptes[i] = 0;
+			as_addrss(victims[i].cv_as, -1);
+			coremap_evicted(victims[i].cv_paddr);
+			nfreed++;
+			continue;
+		}
+		if (zc[i] != ZCACHE_NOENTRY) {
+			*ptes[i] = PTE_MKZC(zc[i]);
+		}
+		else if (victims[i].cv_swapslot != SWAP_NOSLOT) {
+			*ptes[i] = PTE_MKSWAP(victims[i].cv_swapslot);
+			if (zcmiss[i]) {
+				*ptes[i] |= PTE_ZCMISS;
+			}
+		}
+		else {
+			/* Write failed; put it back. */
+			*ptes[i] = saved[i];
+			coremap_unpin(victims[i].cv_paddr);
+			continue;
+		}
+		as_addrss(victims[i].cv_as, -1);
+		coremap_evicted(victims[i].cv_paddr);
+		nfreed++;
+	}
+
+	if (nfreed == 0) {
+		return result == ENOSPC ? ENOMEM : result;
+	}
+	return 0;
+}
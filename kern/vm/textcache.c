@@ -0,0 +1,231 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <coremap.h>
+#include <textcache.h>
+
+/*
+ * Shared text page cache. See textcache.h.
+ *
+ * Entries are kept in a small hash table. Reference counts on cached
+ * frames are only dropped with tc_lock held, so a lookup can never
+ * find a frame whose last reference is going away.
+ *
+ * There can be any number of stale entries for a page besides the
+ * current one, so those are looked up by frame. tc_vcount counts the
+ * entries of the vnodes that hash to each bucket, so that invalidating
+ * a file that was never run, the usual case, costs next to nothing.
+ *
+ * tc_gen, kept for the same buckets, is advanced by every invalidation
+ * whether or not the file has entries, since someone may be reading
+ * it in right now.
+ */
+
+#define TC_HASHSIZE 64
+
+struct tc_entry {
+	struct tc_entry *te_next;	/* hash chain */
+	struct vnode *te_vnode;
+	vaddr_t te_vaddr;
+	paddr_t te_paddr;
+	bool te_stale;			/* the file has changed since */
+};
+
+static struct spinlock tc_lock = SPINLOCK_INITIALIZER;
+static struct tc_entry *tc_hash[TC_HASHSIZE];
+static unsigned tc_vcount[TC_HASHSIZE];
+static unsigned tc_gen[TC_HASHSIZE];
+
+#define TC_VBUCKET(v)  (((uintptr_t)(v) >> 4) % TC_HASHSIZE)
+
+static
+unsigned
+tc_bucket(struct vnode *v, vaddr_t vaddr)
+{
+	return (((uintptr_t)v >> 4) ^ (vaddr >> 12)) % TC_HASHSIZE;
+}
+
+/*
+ * Find the entry for page VADDR of V: the one for frame PADDR, or if
+ * PADDR is 0 the current one. Returns a pointer to the link that
+ * points to it, or to the NULL at the end of its chain.
+ */
+static
+struct tc_entry **
+tc_find(struct vnode *v, vaddr_t vaddr, paddr_t paddr)
+{
+	struct tc_entry **tep;
+	struct tc_entry *te;
+
+	for (tep = &tc_hash[tc_bucket(v, vaddr)]; *tep != NULL;
+	     tep = &te->te_next) {
+		te = *tep;
+		if (te->te_vnode == v && te->te_vaddr == vaddr &&
+		    (paddr == 0 ? !te->te_stale : te->te_paddr == paddr)) {
+			break;
+		}
+	}
+	return tep;
+}
+
+paddr_t
+textcache_get(struct vnode *v, vaddr_t vaddr)
+{
+	struct tc_entry *te;
+	paddr_t pa;
+
+	pa = 0;
+
+	spinlock_acquire(&tc_lock);
+	te = *tc_find(v, vaddr, 0);
+	if (te != NULL) {
+		pa = te->te_paddr;
+		coremap_incref(pa);
+	}
+	spinlock_release(&tc_lock);
+
+	return pa;
+}
+
+unsigned
+textcache_gen(struct vnode *v)
+{
+	unsigned gen;
+
+	spinlock_acquire(&tc_lock);
+	gen = tc_gen[TC_VBUCKET(v)];
+	spinlock_release(&tc_lock);
+
+	return gen;
+}
+
+paddr_t
+textcache_add(struct vnode *v, vaddr_t vaddr, paddr_t paddr, unsigned gen)
+{
+	struct tc_entry *te, *newte;
+	struct tc_entry **tep;
+	bool stale;
+
+	/* Allocate first; kmalloc can't be called with tc_lock held. */
+	newte = kmalloc(sizeof(struct tc_entry));
+
+	spinlock_acquire(&tc_lock);
+	/* If the file may have changed since it was read, don't share. */
+	stale = gen != tc_gen[TC_VBUCKET(v)];
+	tep = tc_find(v, vaddr, 0);
+	te = stale ? NULL : *tep;
+	if (te != NULL) {
+		paddr = te->te_paddr;
+		coremap_incref(paddr);
+	}
+	else if (newte != NULL) {
+		/* If there's no memory for the entry, just don't share. */
+		newte->te_next = *tep;
+		newte->te_vnode = v;
+		newte->te_vaddr = vaddr;
+		newte->te_paddr = paddr;
+		newte->te_stale = stale;
+		*tep = newte;
+		tc_vcount[TC_VBUCKET(v)]++;
+		coremap_settext(paddr);
+		newte = NULL;
+	}
+	spinlock_release(&tc_lock);
+
+	if (newte != NULL) {
+		kfree(newte);
+	}
+	return paddr;
+}
+
+void
+textcache_release(struct vnode *v, vaddr_t vaddr, paddr_t paddr)
+{
+	struct tc_entry **tep;
+	struct tc_entry *te;
+
+	te = NULL;
+
+	spinlock_acquire(&tc_lock);
+	tep = tc_find(v, vaddr, paddr);
+	if (*tep != NULL && coremap_refcount(paddr) == 1) {
+		te = *tep;
+		*tep = te->te_next;
+		tc_vcount[TC_VBUCKET(v)]--;
+	}
+	coremap_free(paddr);
+	spinlock_release(&tc_lock);
+
+	if (te != NULL) {
+		kfree(te);
+	}
+}
+
+bool
+textcache_evict(paddr_t paddr)
+{
+	struct tc_entry **tep;
+	struct tc_entry *te;
+	unsigned i;
+
+	te = NULL;
+
+	spinlock_acquire(&tc_lock);
+	if (coremap_refcount(paddr) != 1) {
+		spinlock_release(&tc_lock);
+		return false;
+	}
+	for (i = 0; i < TC_HASHSIZE && te == NULL; i++) {
+		for (tep = &tc_hash[i]; *tep != NULL; tep = &(*tep)->te_next) {
+			if ((*tep)->te_paddr == paddr) {
+				te = *tep;
+				*tep = te->te_next;
+				tc_vcount[TC_VBUCKET(te->te_vnode)]--;
+				break;
+			}
+		}
+	}
+	spinlock_release(&tc_lock);
+
+	if (te != NULL) {
+		kfree(te);
+	}
+	return true;
+}
+
+bool
+textcache_current(struct vnode *v, vaddr_t vaddr, paddr_t paddr)
+{
+	struct tc_entry *te;
+	bool current;
+
+	spinlock_acquire(&tc_lock);
+	te = *tc_find(v, vaddr, paddr);
+	current = te != NULL && !te->te_stale;
+	spinlock_release(&tc_lock);
+
+	return current;
+}
+
+void
+textcache_invalidate(struct vnode *v)
+{
+	struct tc_entry *te;
+	unsigned i;
+
+	spinlock_acquire(&tc_lock);
+	tc_gen[TC_VBUCKET(v)]++;
+	if (tc_vcount[TC_VBUCKET(v)] == 0) {
+		/* Not cached; most files written never are. */
+		spinlock_release(&tc_lock);
+		return;
+	}
+	for (i = 0; i < TC_HASHSIZE; i++) {
+		for (te = tc_hash[i]; te != NULL; te = te->te_next) {
+			if (te->te_vnode == v) {
+				te->te_stale = true;
+			}
+		}
+	}
+	spinlock_release(&tc_lock);
+}
@@ -14,6 +14,7 @@
 #include <lib.h>
 #include <synch.h>
 #include <spl.h>
+#include <vm.h>
 #include <uw-vmstats.h>
 
 /* Counters for tracking statistics */
@@ -33,6 +34,16 @@ static const char *stats_names[] = {
  /*  7 */ "Page Faults from ELF",
  /*  8 */ "Page Faults from Swapfile",
  /*  9 */ "Swapfile Writes",
+ /* 10 */ "Zeroed Pool Hits",
+ /* 11 */ "Zeroed Pool Misses",
+ /* 12 */ "TLB Fault-around Loads",
+ /* 13 */ "Compressed Cache Hits",
+ /* 14 */ "Compressed Cache Misses",
+ /* 15 */ "Compressed Cache Stores",
+ /* 16 */ "Compressed Cache Bytes",
+ /* 17 */ "Shared Text Hits",
+ /* 18 */ "Page Cache Hits",
+ /* 19 */ "Page Faults from Files",
 };
 
 
@@ -46,6 +57,16 @@ vmstats_inc(unsigned int index)
     spinlock_release(&stats_lock);
 }
 
+/* ---------------------------------------------------------------------- */
+/* Assumes vmstat_init has already been called */
+void
+vmstats_add(unsigned int index, unsigned int n)
+{
+    spinlock_acquire(&stats_lock);
+      _vmstats_add(index, n);
+    spinlock_release(&stats_lock);
+}
+
 /* ---------------------------------------------------------------------- */
 void
 vmstats_init(void)
@@ -68,6 +89,14 @@ _vmstats_inc(unsigned int index)
   stats_counts[index]++;
 }
 
+/* ---------------------------------------------------------------------- */
+void
+_vmstats_add(unsigned int index, unsigned int n)
+{
+  KASSERT(index < VMSTAT_COUNT);
+  stats_counts[index] += n;
+}
+
 /* ---------------------------------------------------------------------- */
 void
 _vmstats_init(void)
@@ -102,6 +131,8 @@ vmstats_print(void)
   int tlb_faults = 0;
   int elf_plus_swap_reads = 0;
   int disk_reads = 0;
+  int zcache_stores = 0;
+  unsigned int ratio = 0;
 
   kprintf("VMSTATS:\n");
   for (i=0; i<VMSTAT_COUNT; i++) {
@@ -111,8 +142,11 @@ vmstats_print(void)
   tlb_faults = stats_counts[VMSTAT_TLB_FAULT];
   free_plus_replace = stats_counts[VMSTAT_TLB_FAULT_FREE] + stats_counts[VMSTAT_TLB_FAULT_REPLACE];
   disk_plus_zeroed_plus_reload = stats_counts[VMSTAT_PAGE_FAULT_DISK] +
-    stats_counts[VMSTAT_PAGE_FAULT_ZERO] + stats_counts[VMSTAT_TLB_RELOAD];
-  elf_plus_swap_reads = stats_counts[VMSTAT_ELF_FILE_READ] + stats_counts[VMSTAT_SWAP_FILE_READ];
+    stats_counts[VMSTAT_PAGE_FAULT_ZERO] + stats_counts[VMSTAT_TLB_RELOAD] +
+    stats_counts[VMSTAT_ZCACHE_HIT] + stats_counts[VMSTAT_TEXT_HIT] +
+    stats_counts[VMSTAT_PAGECACHE_HIT];
+  elf_plus_swap_reads = stats_counts[VMSTAT_ELF_FILE_READ] + stats_counts[VMSTAT_SWAP_FILE_READ] +
+    stats_counts[VMSTAT_FILE_READ];
   disk_reads = stats_counts[VMSTAT_PAGE_FAULT_DISK];
 
   kprintf("VMSTAT TLB Faults with Free + TLB Faults with Replace = %d\n", free_plus_replace);
@@ -121,17 +155,24 @@ vmstats_print(void)
       tlb_faults, free_plus_replace); 
   }
 
-  kprintf("VMSTAT TLB Reloads + Page Faults (Zeroed) + Page Faults (Disk) = %d\n",
+  kprintf("VMSTAT TLB Reloads + Page Faults (Zeroed) + Page Faults (Disk) + Compressed Cache Hits + Shared Text Hits + Page Cache Hits = %d\n",
     disk_plus_zeroed_plus_reload);
   if (tlb_faults != disk_plus_zeroed_plus_reload) {
-    kprintf("WARNING: TLB Faults (%d) != TLB Reloads + Page Faults (Zeroed) + Page Faults (Disk) (%d)\n",
+    kprintf("WARNING: TLB Faults (%d) != TLB Reloads + Page Faults (Zeroed) + Page Faults (Disk) + Compressed Cache Hits + Shared Text Hits + Page Cache Hits (%d)\n",
       tlb_faults, disk_plus_zeroed_plus_reload); 
   }
 
-  kprintf("VMSTAT ELF File reads + Swapfile reads = %d\n", elf_plus_swap_reads);
+  kprintf("VMSTAT ELF File reads + Swapfile reads + File reads = %d\n", elf_plus_swap_reads);
   if (disk_reads != elf_plus_swap_reads) {
-    kprintf("WARNING: ELF File reads + Swapfile reads != Page Faults (Disk) %d\n",
+    kprintf("WARNING: ELF File reads + Swapfile reads + File reads != Page Faults (Disk) %d\n",
       elf_plus_swap_reads);
   }
+
+  /* Compression ratio, in tenths, of the pages stored in the compressed cache */
+  zcache_stores = stats_counts[VMSTAT_ZCACHE_STORE];
+  if (stats_counts[VMSTAT_ZCACHE_BYTES] > 0) {
+    ratio = (uint64_t)zcache_stores * PAGE_SIZE * 10 / stats_counts[VMSTAT_ZCACHE_BYTES];
+  }
+  kprintf("VMSTAT Compressed Cache ratio = %u.%u:1\n", ratio / 10, ratio % 10);
 }
 /* ---------------------------------------------------------------------- */
@@ -0,0 +1,724 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <proc.h>
+#include <current.h>
+#include <thread.h>
+#include <addrspace.h>
+#include <pagetable.h>
+#include <coremap.h>
+#include <swap.h>
+#include <textcache.h>
+#include <execcache.h>
+#include <pagecache.h>
+#include <zcache.h>
+#include <vnode.h>
+#include <vm.h>
+#include <uw-vmstats.h>
+
+/*
+ * Paged VM system.
+ *
+ * Every address space has a list of regions (addrspace.c) and a
+ * two-level page table (pagetable.c). Pages are mapped one at a time,
+ * so the frames backing a process need not be contiguous, and
+ * vm_fault resolves each TLB miss by looking up the single page that
+ * faulted.
+ *
+ * Physical memory is managed by the coremap (coremap.c), which hands
+ * out both kernel and user pages and takes them back when freed.
+ * Frames are reference counted so that fork can share them
+ * copy-on-write.
+ *
+ * Nothing is loaded when a program is exec'd. The first fault on a
+ * page allocates its frame and reads it from the executable, or
+ * zero-fills it (bss and anything past the end of the file data).
+ * Zero-filled pages come from a pool that idle CPUs keep topped up
+ * (vm_idle), when it has any.
+ *
+ * Pages of read-only regions are mapped without PTE_WRITE, so a write
+ * to one is a fatal fault. Those that come from the executable are
+ * shared by every process running it, through the text cache
+ * (textcache.c), and kept after they exit by the exec image cache
+ * (execcache.c). Pages of files mapped with mmap are shared the same
+ * way, by file offset, through the page cache (pagecache.c); writes to
+ * a private mapping are copy-on-write, and writes to a shared one mark
+ * the cached page dirty.
+ *
+ * When memory runs out, user pages are paged out to swap (swap.c) and
+ * read back in when they are next touched. A frame being worked on is
+ * pinned in the coremap, so the code below pins a page's frame before
+ * it relies on the page table entry pointing at it.
+ */
+
+/* Most rounds of eviction alloc_kpages tries before giving up */
+#define VM_KPAGES_EVICT 16
+
+void
+vm_bootstrap(void)
+{
+	coremap_bootstrap();
+	vm_tlb_bootstrap();
+	vmstats_init();
+	swap_bootstrap();
+}
+
+/*
+ * Return true if the current thread may sleep, and so may page things
+ * out to make room.
+ */
+static
+bool
+vm_can_sleep(void)
+{
+	return curthread != NULL && !curthread->t_in_interrupt &&
+		curthread->t_iplhigh_count == 0;
+}
+
+/* Allocate/free some kernel-space virtual pages */
+vaddr_t
+alloc_kpages(int npages)
+{
+	paddr_t pa;
+	int i;
+
+	pa = coremap_alloc(npages, true);
+	for (i = 0; pa == 0 && i < VM_KPAGES_EVICT && vm_can_sleep(); i++) {
+		if (swap_evict() && !execcache_shrink()) {
+			break;
+		}
+		pa = coremap_alloc(npages, true);
+	}
+	if (pa == 0) {
+		return 0;
+	}
+	return PADDR_TO_KVADDR(pa);
+}
+
+void
+free_kpages(vaddr_t addr)
+{
+	KASSERT(addr >= MIPS_KSEG0);
+	coremap_free(addr - MIPS_KSEG0);
+}
+
+/* Allocate/free a single page of user memory */
+paddr_t
+vm_page_alloc(void)
+{
+	paddr_t pa;
+
+	while ((pa = coremap_alloc(1, false)) == 0) {
+		/* Last of all, give up the pages kept for exec. */
+		if (swap_evict() && !execcache_shrink()) {
+			return 0;
+		}
+	}
+	return pa;
+}
+
+void
+vm_page_free(paddr_t paddr)
+{
+	coremap_free(paddr);
+}
+
+/*
+ * Allocate a zero-filled user page, taking it from the pool of frames
+ * zeroed by idle CPUs when there is one.
+ */
+static
+paddr_t
+vm_page_alloc_zeroed(void)
+{
+	paddr_t pa;
+
+	pa = coremap_alloc_zeroed();
+	if (pa != 0) {
+		vmstats_inc(VMSTAT_ZERO_POOL_HIT);
+		return pa;
+	}
+	vmstats_inc(VMSTAT_ZERO_POOL_MISS);
+
+	pa = vm_page_alloc();
+	if (pa != 0) {
+		bzero((void *)PADDR_TO_KVADDR(pa), PAGE_SIZE);
+	}
+	return pa;
+}
+
+bool
+vm_idle(void)
+{
+	return coremap_zero_one();
+}
+
+/*
+ * If *PTE maps a resident page, pin its frame and return true.
+ */
+static
+bool
+vm_pin_present(pte_t *pte)
+{
+	pte_t entry;
+	paddr_t pa;
+
+	for (;;) {
+		entry = *pte;
+		if ((entry & PTE_PRESENT) == 0) {
+			return false;
+		}
+		pa = entry & PTE_FRAME;
+		if (!coremap_pin(pa)) {
+			continue;
+		}
+		if ((*pte & PTE_PRESENT) && (*pte & PTE_FRAME) == pa) {
+			return true;
+		}
+		/* Paged out while we waited. */
+		coremap_unpin(pa);
+	}
+}
+
+/*
+ * Return the file offset of page VA of the file-backed region VR.
+ */
+static
+off_t
+vm_file_offset(struct vm_region *vr, vaddr_t va)
+{
+	return vr->vr_fileoff + (off_t)(va - vr->vr_filevaddr);
+}
+
+/*
+ * Handle a write to a page mapped without PTE_WRITE, whose frame is
+ * pinned: a copy-on-write page, or one read back from swap. If other
+ * address spaces still share the frame, copy it; otherwise just make
+ * it writeable. A page of a mapped file is made writeable, and marked
+ * dirty, if the mapping is shared, and always copied if not.
+ */
+static
+int
+vm_cow_fault(struct addrspace *as, struct vm_region *vr, vaddr_t va,
+	     pte_t *pte)
+{
+	paddr_t oldpa, newpa;
+	pte_t oldpte;
+
+	if ((vr->vr_perm & VR_WRITE) == 0) {
+		return EFAULT;
+	}
+
+	oldpte = *pte;
+	oldpa = oldpte & PTE_FRAME;
+	if (oldpte & PTE_FILE) {
+		if (vr->vr_perm & VR_SHARED) {
+			pagecache_dirty(vr->vr_vnode, vm_file_offset(vr, va));
+			*pte |= PTE_WRITE;
+			return 0;
+		}
+		/* The cached page must stay as the file has it; copy. */
+	}
+	else if (coremap_refcount(oldpa) == 1) {
+		/* Any copy in swap is about to be out of date. */
+		coremap_dirty(oldpa);
+		coremap_claim(oldpa, as, va);
+		*pte |= PTE_WRITE;
+		return 0;
+	}
+
+	newpa = vm_page_alloc();
+	if (newpa == 0) {
+		return ENOMEM;
+	}
+	memmove((void *)PADDR_TO_KVADDR(newpa),
+		(const void *)PADDR_TO_KVADDR(oldpa), PAGE_SIZE);
+	*pte = newpa | (oldpte & ~(PTE_FRAME | PTE_FILE)) | PTE_WRITE;
+	coremap_claim(newpa, as, va);
+	if (oldpte & PTE_FILE) {
+		pagecache_release(vr->vr_vnode, vm_file_offset(vr, va), oldpa);
+	}
+	else {
+		vm_page_free(oldpa);
+	}
+
+	/* Other CPUs may remember the old frame. */
+	vm_tlb_forget(as);
+	return 0;
+}
+
+/*
+ * Find the part of page VA of region VR, [*START, *END), that comes
+ * from the file. Returns false if none of it does.
+ */
+static
+bool
+vm_file_span(struct vm_region *vr, vaddr_t va, vaddr_t *start,
+	     vaddr_t *end)
+{
+	vaddr_t filetop;
+
+	if (vr->vr_vnode == NULL) {
+		return false;
+	}
+	filetop = vr->vr_filevaddr + vr->vr_filesz;
+	*start = va > vr->vr_filevaddr ? va : vr->vr_filevaddr;
+	*end = va + PAGE_SIZE < filetop ? va + PAGE_SIZE : filetop;
+	return *start < *end;
+}
+
+/*
+ * Allocate a frame for page VA of region VR and fill it with the
+ * page's contents: file data where the region has some, zeroes
+ * everywhere else. The frame is returned pinned in *RET.
+ */
+static
+int
+vm_fill_page(struct vm_region *vr, vaddr_t va, paddr_t *ret)
+{
+	struct iovec iov;
+	struct uio u;
+	vaddr_t start, end;
+	paddr_t pa;
+	char *kva;
+	int result;
+
+	if (!vm_file_span(vr, va, &start, &end)) {
+		pa = vm_page_alloc_zeroed();
+		if (pa == 0) {
+			return ENOMEM;
+		}
+		vmstats_inc(VMSTAT_PAGE_FAULT_ZERO);
+		*ret = pa;
+		return 0;
+	}
+
+	if (start > va || end < va + PAGE_SIZE) {
+		pa = vm_page_alloc_zeroed();
+	}
+	else {
+		pa = vm_page_alloc();
+	}
+	if (pa == 0) {
+		return ENOMEM;
+	}
+	kva = (char *)PADDR_TO_KVADDR(pa);
+
+	uio_kinit(&iov, &u, kva + (start - va), end - start,
+		  vr->vr_fileoff + (start - vr->vr_filevaddr), UIO_READ);
+	result = VOP_READ(vr->vr_vnode, &u);
+	if (result) {
+		vm_page_free(pa);
+		return result;
+	}
+	if (u.uio_resid != 0) {
+		/* short read; problem with executable? */
+		kprintf("vm: short read on segment - file truncated?\n");
+		vm_page_free(pa);
+		return ENOEXEC;
+	}
+
+	vmstats_inc(VMSTAT_PAGE_FAULT_DISK);
+	vmstats_inc(vr->vr_perm & VR_MMAP ? VMSTAT_FILE_READ :
+		    VMSTAT_ELF_FILE_READ);
+	*ret = pa;
+	return 0;
+}
+
+/*
+ * Give page VA of the read-only, file-backed region VR a frame from
+ * the text cache, loading it there first if need be.
+ */
+static
+int
+vm_text_page_in(struct addrspace *as, struct vm_region *vr, vaddr_t va,
+		pte_t *pte)
+{
+	paddr_t pa, newpa;
+	unsigned gen;
+	int result;
+
+	newpa = 0;
+	pa = textcache_get(vr->vr_vnode, va);
+	if (pa != 0) {
+		/* Another run of the program already loaded it. */
+		vmstats_inc(VMSTAT_TEXT_HIT);
+	}
+	else {
+		gen = textcache_gen(vr->vr_vnode);
+		result = vm_fill_page(vr, va, &newpa);
+		if (result) {
+			return result;
+		}
+		pa = textcache_add(vr->vr_vnode, va, newpa, gen);
+		if (pa != newpa) {
+			/* Someone else loaded it meanwhile; use theirs. */
+			vm_page_free(newpa);
+		}
+	}
+
+	if (pa != newpa) {
+		/* We hold a reference, so it is still a user frame. */
+		while (!coremap_pin(pa)) {
+			/* nothing */
+		}
+	}
+
+	*pte = pa | PTE_PRESENT | PTE_VALID | PTE_TEXT;
+	coremap_claim(pa, as, va);
+	return 0;
+}
+
+/*
+ * Give page VA of the file mapping VR a frame from the page cache,
+ * reading it in first if need be. It is mapped read-only, so that
+ * vm_cow_fault sees the first write.
+ */
+static
+int
+vm_file_page_in(struct addrspace *as, struct vm_region *vr, vaddr_t va,
+		pte_t *pte)
+{
+	vaddr_t start, end;
+	paddr_t pa, newpa;
+	off_t offset;
+	int result;
+
+	offset = vm_file_offset(vr, va);
+	newpa = 0;
+	pa = pagecache_get(vr->vr_vnode, offset);
+	if (pa != 0) {
+		/* Another mapping of the file already read it. */
+		vmstats_inc(VMSTAT_PAGECACHE_HIT);
+	}
+	else {
+		result = vm_fill_page(vr, va, &newpa);
+		if (result) {
+			return result;
+		}
+		if (!vm_file_span(vr, va, &start, &end)) {
+			start = end = va;
+		}
+		pa = pagecache_add(vr->vr_vnode, offset, end - start, newpa);
+		if (pa != newpa) {
+			/* Someone else loaded it meanwhile, or no memory. */
+			vm_page_free(newpa);
+			if (pa == 0) {
+				return ENOMEM;
+			}
+		}
+	}
+
+	if (pa != newpa) {
+		/* We hold a reference, so it is still a user frame. */
+		while (!coremap_pin(pa)) {
+			/* nothing */
+		}
+	}
+
+	*pte = pa | PTE_PRESENT | PTE_VALID | PTE_FILE;
+	coremap_claim(pa, as, va);
+	return 0;
+}
+
+int
+vm_page_get(struct addrspace *as, struct vm_region *vr, vaddr_t va,
+	    pte_t *pte)
+{
+	paddr_t pa;
+	unsigned slot;
+	int result;
+
+	if (vm_pin_present(pte)) {
+		/* Referenced again since the clock went past it. */
+		*pte |= PTE_VALID;
+		coremap_claim(*pte & PTE_FRAME, as, va);
+		return 0;
+	}
+
+	if (*pte == 0 && vr->vr_vnode != NULL && (vr->vr_perm & VR_MMAP)) {
+		result = vm_file_page_in(as, vr, va, pte);
+		if (result) {
+			return result;
+		}
+		as_addrss(as, 1);
+		return 0;
+	}
+
+	if (*pte == 0 && vr->vr_vnode != NULL &&
+	    (vr->vr_perm & VR_WRITE) == 0) {
+		result = vm_text_page_in(as, vr, va, pte);
+		if (result) {
+			return result;
+		}
+		as_addrss(as, 1);
+		return 0;
+	}
+
+	if (*pte & PTE_ZCACHED) {
+		pa = vm_page_alloc();
+		if (pa == 0) {
+			return ENOMEM;
+		}
+		/* The cache lets go of it, so it is dirty again. */
+		zcache_load(PTE_ZCINDEX(*pte), pa);
+		vmstats_inc(VMSTAT_ZCACHE_HIT);
+		*pte = pa | PTE_PRESENT | PTE_VALID;
+		if (vr->vr_perm & VR_WRITE) {
+			*pte |= PTE_WRITE;
+		}
+	}
+	else if (*pte & PTE_SWAPPED) {
+		pa = vm_page_alloc();
+		if (pa == 0) {
+			return ENOMEM;
+		}
+		slot = PTE_SWAPSLOT(*pte);
+		result = swap_in(slot, pa);
+		if (result) {
+			vm_page_free(pa);
+			return result;
+		}
+		vmstats_inc(VMSTAT_PAGE_FAULT_DISK);
+		if (*pte & PTE_ZCMISS) {
+			/* The zcache was offered it and had no room. */
+			vmstats_inc(VMSTAT_ZCACHE_MISS);
+		}
+		/*
+		 * Keep the slot, and map the page read-only so that
+		 * the first write (vm_cow_fault) tells us it is dirty.
+		 */
+		coremap_setslot(pa, slot);
+		*pte = pa | PTE_PRESENT | PTE_VALID;
+	}
+	else {
+		KASSERT(*pte == 0);
+		result = vm_fill_page(vr, va, &pa);
+		if (result) {
+			return result;
+		}
+		*pte = pa | PTE_PRESENT | PTE_VALID;
+		if (vr->vr_perm & VR_WRITE) {
+			*pte |= PTE_WRITE;
+		}
+	}
+
+	coremap_claim(pa, as, va);
+	as_addrss(as, 1);
+	return 0;
+}
+
+void
+vm_page_discard(struct addrspace *as, struct vm_region *vr, vaddr_t va,
+		pte_t *pte)
+{
+	if (vm_pin_present(pte)) {
+		as_addrss(as, -1);
+		if (*pte & PTE_TEXT) {
+			/* Keep it for the next run of the program. */
+			execcache_keep(vr->vr_vnode, va, *pte & PTE_FRAME);
+			textcache_release(vr->vr_vnode, va, *pte & PTE_FRAME);
+		}
+		else if (*pte & PTE_FILE) {
+			pagecache_release(vr->vr_vnode, vm_file_offset(vr, va),
+					  *pte & PTE_FRAME);
+		}
+		else {
+			vm_page_free(*pte & PTE_FRAME);
+		}
+	}
+	else if (*pte & PTE_SWAPPED) {
+		swap_free(PTE_SWAPSLOT(*pte));
+	}
+	else if (*pte & PTE_ZCACHED) {
+		zcache_free(PTE_ZCINDEX(*pte));
+	}
+	*pte = 0;
+}
+
+int
+vm_page_sync(struct vm_region *vr, vaddr_t va, pte_t *pte)
+{
+	paddr_t pa;
+	int result;
+
+	KASSERT(vr->vr_perm & VR_SHARED);
+
+	if (!vm_pin_present(pte)) {
+		return 0;
+	}
+	pa = *pte & PTE_FRAME;
+	result = 0;
+	if (*pte & PTE_FILE) {
+		result = pagecache_sync(vr->vr_vnode, vm_file_offset(vr, va),
+					pa);
+	}
+	coremap_unpin(pa);
+	return result;
+}
+
+/*
+ * Choose the pages around a fault at VA in region VR to map as well,
+ * [*LO, *HI). A fault just past the previous one, or just before it
+ * (a stack), within the current window looks like a sequential scan:
+ * the window doubles, up to vr_around, and only pages further along in
+ * that direction are mapped. Any other fault shrinks the window back
+ * and maps a few pages either side.
+ */
+static
+void
+vm_faultaround_range(struct vm_region *vr, vaddr_t va, vaddr_t *lo,
+		     vaddr_t *hi)
+{
+	vaddr_t last, base, top, reach;
+	unsigned w;
+
+	last = vr->vr_lastfault;
+	w = vr->vr_window;
+	reach = (w + 1) * PAGE_SIZE;
+	base = vr->vr_base;
+	top = base + vr->vr_npages * PAGE_SIZE;
+
+	if (va > last && va - last <= reach) {
+		w = w * 2 < vr->vr_around ? w * 2 : vr->vr_around;
+		*lo = va + PAGE_SIZE;
+		*hi = top - va > w * PAGE_SIZE ? va + (w + 1) * PAGE_SIZE : top;
+	}
+	else if (va < last && last - va <= reach) {
+		w = w * 2 < vr->vr_around ? w * 2 : vr->vr_around;
+		*lo = va - base > w * PAGE_SIZE ? va - w * PAGE_SIZE : base;
+		*hi = va;
+	}
+	else {
+		w = VM_FAULTAROUND_MIN < vr->vr_around ?
+			VM_FAULTAROUND_MIN : vr->vr_around;
+		*lo = va - base > (w / 2) * PAGE_SIZE ?
+			va - (w / 2) * PAGE_SIZE : base;
+		*hi = top - va > (w - w / 2) * PAGE_SIZE ?
+			va + (w - w / 2 + 1) * PAGE_SIZE : top;
+	}
+
+	vr->vr_window = w > 0 ? w : 1;
+	vr->vr_lastfault = va;
+}
+
+/*
+ * Map the resident neighbours of the page at VA, so that touching
+ * them does not take a fault each.
+ */
+static
+void
+vm_faultaround(struct addrspace *as, struct vm_region *vr, vaddr_t va)
+{
+	vaddr_t lo, hi, nva;
+	pte_t *pte;
+
+	if (vr->vr_around == 0) {
+		return;
+	}
+
+	vm_faultaround_range(vr, va, &lo, &hi);
+	for (nva = lo; nva < hi; nva += PAGE_SIZE) {
+		if (nva == va) {
+			continue;
+		}
+		pte = pt_lookup(as->as_pt, nva, false);
+		if (pte != NULL && vm_tlb_preload(nva, pte)) {
+			vmstats_inc(VMSTAT_TLB_FAULTAROUND);
+		}
+	}
+}
+
+int
+vm_fault(int faulttype, vaddr_t faultaddress)
+{
+	struct addrspace *as;
+	struct vm_region *vr;
+	pte_t *pte;
+	int result;
+
+	faultaddress &= PAGE_FRAME;
+
+	DEBUG(DB_VM, "vm: fault: 0x%x\n", faultaddress);
+
+	switch (faulttype) {
+	    case VM_FAULT_READONLY:
+	    case VM_FAULT_READ:
+	    case VM_FAULT_WRITE:
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	if (curproc == NULL) {
+		/*
+		 * No process. This is probably a kernel fault early
+		 * in boot. Return EFAULT so as to panic instead of
+		 * getting into an infinite faulting loop.
+		 */
+		return EFAULT;
+	}
+
+	as = curproc_getas();
+	if (as == NULL) {
+		/*
+		 * No address space set up. This is probably also a
+		 * kernel fault early in boot.
+		 */
+		return EFAULT;
+	}
+
+	vr = as_find_region(as, faultaddress);
+	if (vr == NULL) {
+		vr = as_grow_stack(as, faultaddress);
+		if (vr == NULL) {
+			return EFAULT;
+		}
+	}
+	if ((vr->vr_perm & (VR_READ | VR_WRITE | VR_EXEC)) == 0) {
+		/* A PROT_NONE mapping. */
+		return EFAULT;
+	}
+
+	vmstats_inc(VMSTAT_TLB_FAULT);
+	as_addfault(as);
+
+	pte = pt_lookup(as->as_pt, faultaddress, true);
+	if (pte == NULL) {
+		return ENOMEM;
+	}
+
+	if (*pte & PTE_PRESENT) {
+		vmstats_inc(VMSTAT_TLB_RELOAD);
+	}
+
+	result = vm_page_get(as, vr, faultaddress, pte);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * A write to a page mapped without PTE_WRITE is a write to a
+	 * copy-on-write page. Resolve it now rather than loading a
+	 * read-only translation and taking a second fault.
+	 */
+	if (faulttype != VM_FAULT_READ && (*pte & PTE_WRITE) == 0) {
+		result = vm_cow_fault(as, vr, faultaddress, pte);
+		if (result) {
+			coremap_unpin(*pte & PTE_FRAME);
+			return result;
+		}
+	}
+
+	/* Load the translation before the frame can be paged out. */
+	DEBUG(DB_VM, "vm: 0x%x -> 0x%x\n", faultaddress, *pte & PTE_FRAME);
+	result = vm_tlb_load(faultaddress, *pte & ~PTE_SWBITS);
+	coremap_unpin(*pte & PTE_FRAME);
+	if (result) {
+		return result;
+	}
+
+	vm_faultaround(as, vr, faultaddress);
+	return 0;
+}
@@ -0,0 +1,339 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <coremap.h>
+#include <zcache.h>
+#include <uw-vmstats.h>
+
+/*
+ * Compressed in-memory swap cache. See zcache.h.
+ *
+ * Compressed pages are packed two to a frame, one in each half.
+ * Frames are taken straight from the coremap, never by evicting, so
+ * storing a page cannot recurse into the pager; while memory is tight
+ * the frames freed by one round of eviction hold the pages of the
+ * next. At most one frame is ever half empty (zc_open): when a page
+ * goes away and leaves another half-empty frame, its buddy is moved
+ * into the open one and the frame is freed.
+ *
+ * The compressed form is a sequence of records, each a header word
+ * followed by its data. A header with the low bit set is a run: the
+ * next word, repeated (header >> 1) times. Otherwise it is (header >> 1)
+ * literal words.
+ */
+
+#define ZC_WORDS      (PAGE_SIZE / sizeof(uint32_t))
+#define ZC_HALFWORDS  (ZC_WORDS / 2)
+#define ZC_TOOBIG     (ZC_HALFWORDS + 1)
+#define ZC_MINRUN     3		/* shorter runs are cheaper as literals */
+#define ZC_NONE       ZCACHE_NOENTRY
+
+/* Entry kinds */
+#define ZC_FREE    0
+#define ZC_FILL    1		/* every word is ze_fill */
+#define ZC_PACKED  2		/* compressed, in half ze_half of ze_frame */
+
+struct zc_entry {
+	unsigned ze_kind;
+	uint32_t ze_fill;
+	paddr_t ze_frame;
+	unsigned ze_half;
+	unsigned ze_buddy;	/* entry in the other half, or ZC_NONE */
+};
+
+/* zc_lock protects everything here, and the contents of our frames. */
+static struct spinlock zc_lock = SPINLOCK_INITIALIZER;
+static struct zc_entry zc_entries[ZCACHE_NENTRIES];
+static unsigned zc_hint;	/* where to start looking for a free entry */
+static unsigned zc_open = ZC_NONE;	/* entry alone in its frame */
+static unsigned zc_nframes;
+
+static
+uint32_t *
+zc_data(struct zc_entry *ze)
+{
+	return (uint32_t *)PADDR_TO_KVADDR(ze->ze_frame) +
+		ze->ze_half * ZC_HALFWORDS;
+}
+
+/*
+ * Return the number of words from SRC[I] on that are the same as it.
+ */
+static
+unsigned
+zc_runlen(const uint32_t *src, unsigned i)
+{
+	unsigned j;
+
+	for (j = i + 1; j < ZC_WORDS && src[j] == src[i]; j++) {
+		/* nothing */
+	}
+	return j - i;
+}
+
+/*
+ * Run-length code the page SRC into DST, or if DST is NULL just work
+ * out how long that would be. Returns the length in words, or
+ * ZC_TOOBIG as soon as it is clear it won't fit in half a page.
+ */
+static
+unsigned
+zc_compress(const uint32_t *src, uint32_t *dst)
+{
+	unsigned i, j, n, len;
+
+	len = 0;
+	i = 0;
+	while (i < ZC_WORDS) {
+		n = zc_runlen(src, i);
+		if (n >= ZC_MINRUN) {
+			if (len + 2 > ZC_HALFWORDS) {
+				return ZC_TOOBIG;
+			}
+			if (dst != NULL) {
+				dst[len] = (n << 1) | 1;
+				dst[len + 1] = src[i];
+			}
+			len += 2;
+			i += n;
+			continue;
+		}
+
+		/* Literals, up to the next run worth coding. */
+		j = i + n;
+		while (j < ZC_WORDS && (n = zc_runlen(src, j)) < ZC_MINRUN) {
+			j += n;
+		}
+		n = j - i;
+		if (len + 1 + n > ZC_HALFWORDS) {
+			return ZC_TOOBIG;
+		}
+		if (dst != NULL) {
+			dst[len] = n << 1;
+			memcpy(dst + len + 1, src + i, n * sizeof(uint32_t));
+		}
+		len += 1 + n;
+		i = j;
+	}
+	return len;
+}
+
+static
+void
+zc_decompress(const uint32_t *src, uint32_t *dst)
+{
+	unsigned i, k, n;
+
+	i = 0;
+	while (i < ZC_WORDS) {
+		n = src[0] >> 1;
+		KASSERT(n > 0 && i + n <= ZC_WORDS);
+		if (src[0] & 1) {
+			for (k = 0; k < n; k++) {
+				dst[i + k] = src[1];
+			}
+			src += 2;
+		}
+		else {
+			memcpy(dst + i, src + 1, n * sizeof(uint32_t));
+			src += 1 + n;
+		}
+		i += n;
+	}
+}
+
+/*
+ * Find a free entry. Called with zc_lock held.
+ */
+static
+unsigned
+zc_alloc(void)
+{
+	unsigned i, ix;
+
+	for (i = 0; i < ZCACHE_NENTRIES; i++) {
+		ix = (zc_hint + i) % ZCACHE_NENTRIES;
+		if (zc_entries[ix].ze_kind == ZC_FREE) {
+			zc_hint = (ix + 1) % ZCACHE_NENTRIES;
+			return ix;
+		}
+	}
+	return ZC_NONE;
+}
+
+/*
+ * Release entry IX. Returns a frame that is now empty and should be
+ * freed, or 0. Called with zc_lock held.
+ */
+static
+paddr_t
+zc_release(unsigned ix)
+{
+	struct zc_entry *ze, *buddy, *open;
+	const uint32_t *from;
+	paddr_t frame;
+
+	ze = &zc_entries[ix];
+	KASSERT(ze->ze_kind != ZC_FREE);
+
+	frame = 0;
+	if (ze->ze_kind == ZC_PACKED) {
+		if (ze->ze_buddy == ZC_NONE) {
+			KASSERT(zc_open == ix);
+			zc_open = ZC_NONE;
+			frame = ze->ze_frame;
+		}
+		else if (zc_open == ZC_NONE) {
+			zc_entries[ze->ze_buddy].ze_buddy = ZC_NONE;
+			zc_open = ze->ze_buddy;
+		}
+		else {
+			/* Move our buddy in with the open one. */
+			buddy = &zc_entries[ze->ze_buddy];
+			open = &zc_entries[zc_open];
+			from = zc_data(buddy);
+			buddy->ze_frame = open->ze_frame;
+			buddy->ze_half = 1 - open->ze_half;
+			memcpy(zc_data(buddy), from,
+			       ZC_HALFWORDS * sizeof(uint32_t));
+			buddy->ze_buddy = zc_open;
+			open->ze_buddy = ze->ze_buddy;
+			zc_open = ZC_NONE;
+			frame = ze->ze_frame;
+		}
+		if (frame != 0) {
+			zc_nframes--;
+		}
+	}
+	ze->ze_kind = ZC_FREE;
+	return frame;
+}
+
+int
+zcache_store(paddr_t paddr, unsigned *ret)
+{
+	const uint32_t *src;
+	struct zc_entry *ze;
+	paddr_t frame;
+	unsigned ix, len;
+
+	src = (const uint32_t *)PADDR_TO_KVADDR(paddr);
+
+	if (zc_runlen(src, 0) == ZC_WORDS) {
+		spinlock_acquire(&zc_lock);
+		ix = zc_alloc();
+		if (ix == ZC_NONE) {
+			spinlock_release(&zc_lock);
+			return ENOSPC;
+		}
+		ze = &zc_entries[ix];
+		ze->ze_kind = ZC_FILL;
+		ze->ze_fill = src[0];
+		spinlock_release(&zc_lock);
+
+		vmstats_inc(VMSTAT_ZCACHE_STORE);
+		vmstats_add(VMSTAT_ZCACHE_BYTES, sizeof(uint32_t));
+		*ret = ix;
+		return 0;
+	}
+
+	len = zc_compress(src, NULL);
+	if (len == ZC_TOOBIG) {
+		return ENOSPC;
+	}
+
+	/* Get a frame in case there's no open half; not under zc_lock. */
+	frame = 0;
+	if (zc_open == ZC_NONE && zc_nframes < ZCACHE_MAXFRAMES) {
+		frame = coremap_alloc(1, true);
+	}
+
+	spinlock_acquire(&zc_lock);
+	ix = ZC_NONE;
+	if (zc_open != ZC_NONE || frame != 0) {
+		ix = zc_alloc();
+	}
+	if (ix == ZC_NONE) {
+		spinlock_release(&zc_lock);
+		if (frame != 0) {
+			coremap_free(frame);
+		}
+		return ENOSPC;
+	}
+
+	ze = &zc_entries[ix];
+	ze->ze_kind = ZC_PACKED;
+	if (zc_open != ZC_NONE) {
+		ze->ze_frame = zc_entries[zc_open].ze_frame;
+		ze->ze_half = 1 - zc_entries[zc_open].ze_half;
+		ze->ze_buddy = zc_open;
+		zc_entries[zc_open].ze_buddy = ix;
+		zc_open = ZC_NONE;
+	}
+	else {
+		ze->ze_frame = frame;
+		ze->ze_half = 0;
+		ze->ze_buddy = ZC_NONE;
+		zc_open = ix;
+		zc_nframes++;
+		frame = 0;
+	}
+	zc_compress(src, zc_data(ze));
+	spinlock_release(&zc_lock);
+
+	if (frame != 0) {
+		coremap_free(frame);
+	}
+
+	vmstats_inc(VMSTAT_ZCACHE_STORE);
+	vmstats_add(VMSTAT_ZCACHE_BYTES, len * sizeof(uint32_t));
+	*ret = ix;
+	return 0;
+}
+
+void
+zcache_load(unsigned index, paddr_t paddr)
+{
+	struct zc_entry *ze;
+	uint32_t *dst;
+	paddr_t frame;
+	unsigned i;
+
+	KASSERT(index < ZCACHE_NENTRIES);
+	dst = (uint32_t *)PADDR_TO_KVADDR(paddr);
+
+	spinlock_acquire(&zc_lock);
+	ze = &zc_entries[index];
+	if (ze->ze_kind == ZC_FILL) {
+		for (i = 0; i < ZC_WORDS; i++) {
+			dst[i] = ze->ze_fill;
+		}
+	}
+	else {
+		KASSERT(ze->ze_kind == ZC_PACKED);
+		zc_decompress(zc_data(ze), dst);
+	}
+	frame = zc_release(index);
+	spinlock_release(&zc_lock);
+
+	if (frame != 0) {
+		coremap_free(frame);
+	}
+}
+
+void
+zcache_free(unsigned index)
+{
+	paddr_t frame;
+
+	KASSERT(index < ZCACHE_NENTRIES);
+
+	spinlock_acquire(&zc_lock);
+	frame = zc_release(index);
+	spinlock_release(&zc_lock);
+
+	if (frame != 0) {
+		coremap_free(frame);
+	}
+}
@@ -0,0 +1,127 @@
+/*
+ * argmaxtest - test execv() with argument lists near ARG_MAX.
+ *
+ * The program name, the argument strings and the argv array all have
+ * to fit in ARG_MAX bytes. A list that nearly fills that must arrive
+ * intact; one that doesn't fit, or a single argument longer than
+ * ARG_MAX, must fail with E2BIG and leave the caller running.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <errno.h>
+#include <err.h>
+
+#define PROG    "/testbin/argmaxtest"
+#define ARGLEN  1000			/* length of each filler argument */
+#define NFIT    64			/* this many fit, with argv */
+#define NBIG    66			/* and this many don't */
+
+static char strings[NBIG][ARGLEN + 1];
+static char *args[NBIG + 3];
+static char huge[ARG_MAX + 1];
+
+/*
+ * Set up args as the program name, "check", and N filler arguments.
+ */
+static
+void
+mkargs(int n)
+{
+	int i;
+
+	args[0] = (char *)"argmaxtest";
+	args[1] = (char *)"check";
+	for (i = 0; i < n; i++) {
+		memset(strings[i], 'a' + i % 26, ARGLEN);
+		strings[i][ARGLEN] = 0;
+		args[i + 2] = strings[i];
+	}
+	args[n + 2] = NULL;
+}
+
+/*
+ * In the child: check that we got NFIT filler arguments.
+ */
+static
+int
+check(int argc, char *argv[])
+{
+	int i, j;
+
+	if (argc != NFIT + 2) {
+		warnx("got %d arguments, not %d", argc, NFIT + 2);
+		return 1;
+	}
+	for (i = 0; i < NFIT; i++) {
+		for (j = 0; j < ARGLEN; j++) {
+			if (argv[i + 2][j] != 'a' + i % 26) {
+				warnx("argument %d is wrong at %d", i + 2, j);
+				return 1;
+			}
+		}
+		if (argv[i + 2][ARGLEN] != 0) {
+			warnx("argument %d is too long", i + 2);
+			return 1;
+		}
+	}
+	if (argv[argc] != NULL) {
+		warnx("argv is not NULL-terminated");
+		return 1;
+	}
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	pid_t pid;
+	int status;
+
+	if (argc > 1 && !strcmp(argv[1], "check")) {
+		return check(argc, argv);
+	}
+
+	/* Nearly ARG_MAX bytes get through. */
+	mkargs(NFIT);
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		execv(PROG, args);
+		err(1, "execv with %d bytes of arguments",
+		    NFIT * (ARGLEN + 1));
+	}
+	if (waitpid(pid, &status, 0) != pid) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "arguments near ARG_MAX did not arrive intact");
+	}
+
+	/* A few more don't. */
+	mkargs(NBIG);
+	execv(PROG, args);
+	if (errno != E2BIG) {
+		err(1, "execv with too many arguments");
+	}
+
+	/* Nor does one argument longer than ARG_MAX. */
+	memset(huge, 'x', ARG_MAX);
+	huge[ARG_MAX] = 0;
+	args[2] = huge;
+	args[3] = NULL;
+	execv(PROG, args);
+	if (errno != E2BIG) {
+		err(1, "execv with an argument longer than ARG_MAX");
+	}
+
+	printf("argmaxtest: passed\n");
+	return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * mmaptest - test mapping files with mmap().
+ *
+ * Writes a file, maps it privately and then shared, and checks that
+ * private changes stay private while shared ones reach the file after
+ * msync and munmap. Give it a file name on an SFS volume (the default
+ * is in the current directory) to test the SFS side:
+ *
+ *	/testbin/mmaptest lhd0:mmaptest.dat
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define PAGE    4096
+#define FILELEN (2 * PAGE + PAGE / 2)	/* ends part way into a page */
+#define MAPLEN  (3 * PAGE)
+
+static char buf[MAPLEN];
+
+static
+char
+pattern(int i)
+{
+	return 'a' + (i * 7 + i / PAGE) % 26;
+}
+
+/* the byte at I of the file after the shared mapping has written to it */
+static
+char
+changed(int i)
+{
+	return i % 1000 == 0 ? 'X' : pattern(i);
+}
+
+static
+int
+openfile(const char *path, int flags)
+{
+	int fd;
+
+	fd = open(path, flags, 0664);
+	if (fd < 0) {
+		err(1, "%s: open", path);
+	}
+	return fd;
+}
+
+static
+char *
+map(int fd, int flags)
+{
+	void *p;
+
+	p = mmap(NULL, MAPLEN, PROT_READ | PROT_WRITE, flags, fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "mmap");
+	}
+	return p;
+}
+
+static
+void
+check(const char *p, char (*expect)(int), const char *what)
+{
+	int i;
+
+	for (i = 0; i < FILELEN; i++) {
+		if (p[i] != expect(i)) {
+			errx(1, "%s: byte %d is %d, not %d", what, i,
+			     p[i], expect(i));
+		}
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *path;
+	char *p;
+	int fd, i, n;
+
+	path = argc > 1 ? argv[1] : "mmaptest.dat";
+
+	/* Make the file. */
+	for (i = 0; i < FILELEN; i++) {
+		buf[i] = pattern(i);
+	}
+	fd = openfile(path, O_RDWR | O_CREAT | O_TRUNC);
+	n = write(fd, buf, FILELEN);
+	if (n != FILELEN) {
+		err(1, "%s: write", path);
+	}
+
+	/* A private mapping sees the file, and past its end zeros. */
+	p = map(fd, MAP_PRIVATE);
+	check(p, pattern, "private mapping");
+	for (i = FILELEN; i < MAPLEN; i++) {
+		if (p[i] != 0) {
+			errx(1, "private mapping: byte %d past EOF is %d",
+			     i, p[i]);
+		}
+	}
+	for (i = 0; i < FILELEN; i++) {
+		p[i] = '?';
+	}
+	if (munmap(p, MAPLEN)) {
+		err(1, "munmap");
+	}
+
+	/* Its writes don't show through a shared one; write through that. */
+	p = map(fd, MAP_SHARED);
+	check(p, pattern, "shared mapping after private writes");
+	for (i = 0; i < FILELEN; i += 1000) {
+		p[i] = 'X';
+	}
+	if (msync(p, MAPLEN, MS_SYNC)) {
+		err(1, "msync");
+	}
+	if (munmap(p, MAPLEN)) {
+		err(1, "munmap");
+	}
+	close(fd);
+
+	/* The file has the shared writes, and has not grown. */
+	fd = openfile(path, O_RDONLY);
+	memset(buf, 0, sizeof(buf));
+	n = read(fd, buf, MAPLEN);
+	if (n != FILELEN) {
+		errx(1, "%s: read %d bytes, not %d", path, n, FILELEN);
+	}
+	check(buf, changed, "file after msync");
+
+	/* Read-only descriptors can't be written through a mapping. */
+	if (mmap(NULL, MAPLEN, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+	    != MAP_FAILED) {
+		errx(1, "shared writable mapping of a read-only file worked");
+	}
+	if (errno != EACCES) {
+		err(1, "shared writable mapping of a read-only file");
+	}
+
+	/* But they can be mapped for reading. */
+	p = mmap(NULL, MAPLEN, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "read-only mmap");
+	}
+	check(p, changed, "read-only mapping");
+	munmap(p, MAPLEN);
+	close(fd);
+
+	printf("mmaptest: passed\n");
+	return 0;
+}
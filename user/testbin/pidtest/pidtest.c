@@ -0,0 +1,97 @@
+/*
+ * pidtest - test PID allocation when the process table fills up.
+ *
+ * Children that exit hold on to their PIDs until they are waited for,
+ * so forking children that exit straight away, and not waiting for
+ * them, fills the process table; fork must then fail with ENPROC.
+ * Once they have been waited for, fork works again, and the PIDs just
+ * freed are not handed straight back out.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <limits.h>
+#include <errno.h>
+#include <err.h>
+
+/* More processes than the kernel's table can hold */
+#define MAXKIDS 1024
+
+/* Children forked after the table has emptied */
+#define NAFTER  16
+
+static pid_t kids[MAXKIDS];
+
+static
+void
+reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) != pid) {
+		err(1, "waitpid %d", pid);
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "pid %d: wait status 0x%x", pid, status);
+	}
+}
+
+int
+main(void)
+{
+	pid_t pid;
+	int n, i, j;
+
+	/* Fill the table with exited children. */
+	for (n = 0; n < MAXKIDS; n++) {
+		pid = fork();
+		if (pid < 0) {
+			break;
+		}
+		if (pid == 0) {
+			_exit(0);
+		}
+		if (pid < PID_MIN || pid > PID_MAX) {
+			errx(1, "fork returned PID %d", pid);
+		}
+		for (i = 0; i < n; i++) {
+			if (kids[i] == pid) {
+				errx(1, "PID %d handed out twice", pid);
+			}
+		}
+		kids[n] = pid;
+	}
+	if (n == MAXKIDS) {
+		errx(1, "forked %d children without filling the table", n);
+	}
+	if (errno != ENPROC) {
+		err(1, "fork failed after %d children, but not with ENPROC", n);
+	}
+	printf("pidtest: the table filled after %d children\n", n);
+
+	for (i = 0; i < n; i++) {
+		reap(kids[i]);
+	}
+
+	/* There is room again, and the old PIDs are not reused yet. */
+	for (j = 0; j < NAFTER; j++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork after emptying the table");
+		}
+		if (pid == 0) {
+			_exit(0);
+		}
+		for (i = 0; i < n; i++) {
+			if (kids[i] == pid) {
+				errx(1, "PID %d reused straight away", pid);
+			}
+		}
+		reap(pid);
+	}
+
+	printf("pidtest: passed\n");
+	return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * spawntest - test vfork() and spawn().
+ *
+ * A vforked child runs in its parent's address space until it calls
+ * execv or _exit, and the parent doesn't run until then. spawn starts
+ * a program in a new child without copying the parent at all, and
+ * reports load errors to the caller.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define PROG "/testbin/spawntest"
+
+static volatile int shared;
+
+/*
+ * Wait for PID and check that it exited with CODE.
+ */
+static
+void
+reap(pid_t pid, int code, const char *what)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) != pid) {
+		err(1, "%s: waitpid", what);
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != code) {
+		errx(1, "%s: wait status 0x%x, expected exit %d", what,
+		     status, code);
+	}
+}
+
+static
+void
+test_vfork(void)
+{
+	pid_t pid;
+
+	shared = 0;
+	pid = vfork();
+	if (pid < 0) {
+		err(1, "vfork");
+	}
+	if (pid == 0) {
+		/* This is our parent's memory. */
+		shared = 1;
+		_exit(3);
+	}
+	if (shared != 1) {
+		errx(1, "vfork: the child did not share our address space");
+	}
+	reap(pid, 3, "vfork then _exit");
+}
+
+static
+void
+test_vfork_exec(void)
+{
+	char *args[4];
+	pid_t pid;
+
+	args[0] = (char *)"spawntest";
+	args[1] = (char *)"exit";
+	args[2] = (char *)"7";
+	args[3] = NULL;
+
+	shared = 0;
+	pid = vfork();
+	if (pid < 0) {
+		err(1, "vfork");
+	}
+	if (pid == 0) {
+		shared = 2;
+		execv(PROG, args);
+		_exit(99);
+	}
+	/* The child's writes before exec land in our memory too. */
+	if (shared != 2) {
+		errx(1, "vfork: the child did not share our address space");
+	}
+	reap(pid, 7, "vfork then execv");
+}
+
+static
+void
+test_spawn(void)
+{
+	char *args[4];
+	pid_t pid;
+
+	args[0] = (char *)"spawntest";
+	args[1] = (char *)"exit";
+	args[2] = (char *)"42";
+	args[3] = NULL;
+
+	pid = spawn(PROG, args);
+	if (pid < 0) {
+		err(1, "spawn");
+	}
+	reap(pid, 42, "spawn");
+
+	/* Load errors come back to us, and no child is left. */
+	pid = spawn("/testbin/no-such-program", args);
+	if (pid >= 0) {
+		errx(1, "spawn of a missing program returned %d", pid);
+	}
+	if (errno != ENOENT) {
+		err(1, "spawn of a missing program");
+	}
+	if (waitpid(-1, NULL, WNOHANG) >= 0 || errno != ECHILD) {
+		errx(1, "spawn of a missing program left a child");
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc == 3 && !strcmp(argv[1], "exit")) {
+		/* We are the child: exit with the code we were given. */
+		return atoi(argv[2]);
+	}
+
+	test_vfork();
+	test_vfork_exec();
+	test_spawn();
+
+	printf("spawntest: passed\n");
+	return 0;
+}
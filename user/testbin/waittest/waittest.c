@@ -0,0 +1,180 @@
+/*
+ * waittest - test waitpid() with WNOHANG, with pid -1, and on
+ * children killed by a signal.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <signal.h>
+#include <errno.h>
+#include <err.h>
+
+#define NKIDS 4
+
+/* Loops long enough that our parent gets to run first */
+#define SPIN  2000000
+
+static volatile unsigned spin;
+
+static
+pid_t
+dofork(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	return pid;
+}
+
+/*
+ * WNOHANG returns 0 while the child runs, or reaps it once it has
+ * exited; either way we end up with its status.
+ */
+static
+void
+test_nohang(void)
+{
+	pid_t pid, ret;
+	int status;
+
+	pid = dofork();
+	if (pid == 0) {
+		while (spin < SPIN) {
+			spin++;
+		}
+		_exit(5);
+	}
+
+	/* The child may already have finished if it ran first */
+	ret = waitpid(pid, &status, WNOHANG);
+	if (ret < 0) {
+		err(1, "waitpid WNOHANG");
+	}
+	if (ret == 0 && waitpid(pid, &status, 0) != pid) {
+		err(1, "waitpid");
+	}
+	else if (ret != 0 && ret != pid) {
+		errx(1, "WNOHANG returned %d, expected 0 or %d", ret, pid);
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 5) {
+		errx(1, "WNOHANG: wait status 0x%x, expected exit 5",
+		     status);
+	}
+}
+
+/*
+ * pid -1 reaps every exited child, each once, and then fails with
+ * ECHILD.
+ */
+static
+void
+test_any(void)
+{
+	pid_t kids[NKIDS];
+	pid_t pid;
+	int seen[NKIDS];
+	int status, i, n;
+
+	for (i = 0; i < NKIDS; i++) {
+		kids[i] = dofork();
+		if (kids[i] == 0) {
+			_exit(10 + i);
+		}
+		seen[i] = 0;
+	}
+
+	for (n = 0; n < NKIDS; n++) {
+		pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			err(1, "waitpid -1");
+		}
+		for (i = 0; i < NKIDS && kids[i] != pid; i++) {
+			/* nothing */
+		}
+		if (i == NKIDS || seen[i]) {
+			errx(1, "waitpid -1 returned %d", pid);
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 10 + i) {
+			errx(1, "pid %d: wait status 0x%x", pid, status);
+		}
+		seen[i] = 1;
+	}
+
+	if (waitpid(-1, &status, 0) >= 0 || errno != ECHILD) {
+		errx(1, "waitpid -1 with no children did not fail with ECHILD");
+	}
+	if (waitpid(-1, &status, WNOHANG) >= 0 || errno != ECHILD) {
+		errx(1, "WNOHANG with no children did not fail with ECHILD");
+	}
+}
+
+/*
+ * A bad status pointer fails with EFAULT and leaves the child to be
+ * waited for again.
+ */
+static
+void
+test_efault(void)
+{
+	pid_t pid;
+	int status;
+
+	pid = dofork();
+	if (pid == 0) {
+		_exit(6);
+	}
+	if (waitpid(pid, (int *)0x80000000, 0) >= 0 || errno != EFAULT) {
+		errx(1, "waitpid with a kernel status pointer did not fail "
+		     "with EFAULT");
+	}
+	if (waitpid(pid, &status, 0) != pid) {
+		err(1, "waitpid after EFAULT");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 6) {
+		errx(1, "EFAULT: wait status 0x%x, expected exit 6", status);
+	}
+}
+
+/*
+ * A child killed by a fatal fault is reported as signalled.
+ */
+static
+void
+test_signal(void)
+{
+	pid_t pid;
+	int status;
+
+	pid = dofork();
+	if (pid == 0) {
+		*(volatile int *)NULL = 1;
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) != pid) {
+		err(1, "waitpid");
+	}
+	if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGSEGV) {
+		errx(1, "fault: wait status 0x%x, expected SIGSEGV", status);
+	}
+}
+
+int
+main(void)
+{
+	if (waitpid(getpid(), NULL, 0) >= 0 || errno != ECHILD) {
+		errx(1, "waiting for ourselves did not fail with ECHILD");
+	}
+
+	test_nohang();
+	test_any();
+	test_efault();
+	test_signal();
+
+	printf("waittest: passed\n");
+	return 0;
+}